@@ -3,11 +3,18 @@
 
 #include "Constants.h"
 
-#include <fstream>
+#include <algorithm>
+#include <climits>
 #include <iostream>
 
 using namespace BinaryTranslator;
 
+namespace {
+
+const char kSpaces[] = " \t\r";
+
+} // anonymous namespace
+
 Assembler::Assembler(const char* pathToInputFile,
                      const char* pathToOutputFile) :
     pathToInputFile_(pathToInputFile),
@@ -18,89 +25,179 @@ Assembler::~Assembler() = default;
 
 void Assembler::ReadFromFile()
 {
-    std::ifstream inputFile(pathToInputFile_, std::ios_base::in);
-
-    if (!inputFile)
-        throw std::runtime_error("Assembler: Invalid path to file\n");
+    source_ = MappedFile(pathToInputFile_);
+}
 
-    std::string instructionText;
+// Parses mapped source line by line without copying its text
+void Assembler::ParseSource(std::string_view text)
+{
+    instructions_.clear();
+    labels_.clear();
+    labelIds_.clear();
+    definitions_.clear();
+    instructions_.reserve(std::count(text.begin(), text.end(), '\n') + 1);
+
+    while (!text.empty()) {
+        size_t endLine = text.find('\n');
+        std::string_view instText = text.substr(0, endLine);
+        text.remove_prefix(endLine == std::string_view::npos ? text.size()
+                                                              : endLine + 1);
+
+        if (instText.find('#') != std::string_view::npos)
+            continue;
 
-    while (getline(inputFile, instructionText, '\n')) {
-        if (instructionText.find_first_of("#") != std::string::npos)
+        size_t begin = instText.find_first_not_of(kSpaces);
+        if (begin == std::string_view::npos)
             continue;
+        instText.remove_prefix(begin);
+        instText.remove_suffix(instText.size() -
+                               instText.find_last_not_of(kSpaces) - 1);
 
-        if (!instructionText[0])
+        if (instText[0] == ':') {
+            DefineLabel(instText.substr(1));
             continue;
+        }
 
-        instructionsText_.push_back(instructionText);
+        Instruction inst;
+        inst.ParseInstruction(instText);
+
+        int argType = inst.GetArgType();
+        if (argType == LABEL || argType == WIDE_LABEL)
+            inst.SetLabelId(InternLabel(inst.GetLabel()));
+
+        instructions_.push_back(inst);
     }
+}
 
-    inputFile.close();
+uint32_t Assembler::InternLabel(std::string_view name)
+{
+    auto [labelId, isNew] = labelIds_.emplace(name, labels_.size());
+    if (isNew)
+        labels_.push_back(Label{name});
+
+    return labelId->second;
+}
+
+// Label marks the next instruction of source
+void Assembler::DefineLabel(std::string_view name)
+{
+    uint32_t labelId = InternLabel(name);
+    if (labels_[labelId].iInst != SIZE_MAX)
+        throw std::runtime_error("Assembler: Redefinition of label " +
+                                 std::string(name));
+
+    labels_[labelId].iInst = instructions_.size();
+    definitions_.push_back(labelId);
 }
 
 void Assembler::Assemble()
 {
     ReadFromFile();
+    Assemble(source_.GetText());
+    WriteToFile();
+}
 
-    std::string label;
-    OffsetLabel temp;
+ByteSpan Assembler::Assemble(std::string_view source)
+{
+    ParseSource(source);
 
-    for (const auto& instText : instructionsText_) {
-        if (instText[0] == ':') {
-            label = instText.substr(1);
-            labels_.insert(make_pair(label, temp));
-        }
-        else {
-            Instruction inst;
-            try {
-                inst.ParseInstruction(instText);
-            }
-            catch (std::exception &exception) {
-                std::cerr << exception.what();
-                exit(EXIT_FAILURE);
-            }
-            if (!label.empty()) {
-                inst.SetLabeled(label);
-                label.erase();
-            }
-            instructions_.push_back(std::move(inst));
-        }
-    }
+    // Branch relaxation: jumps which are out of range are widened by the
+    // pass which finds them, instructions only grow, so it stops
+    while (!ConvertToByteCode())
+        ;
 
-    ConvertToByteCode();
+    return GetByteCode();
 }
 
-void Assembler::ConvertToByteCode()
+ByteSpan Assembler::GetByteCode() const
 {
-    FILE *outputFile = fopen(pathToOutputFile_.c_str(), "wb");
+    return {bytecode_.data(), bytecode_.size()};
+}
 
-    if (outputFile == nullptr)
-        throw std::runtime_error("Assembler: Can`t create output file");
+// Encodes instructions in one pass into preallocated bytecode_. Labels
+// behind the jump are known and choose its encoding at once, labels ahead
+// are recorded as fixups and patched at the end. Returns false if a patched
+// label is out of range of 8-bit offset, then the jump is widened and
+// instructions have to be encoded again.
+bool Assembler::ConvertToByteCode()
+{
+    bytecode_.resize(instructions_.size() * MAX_SIZE_INSTR);
+    fixups_.clear();
+    for (auto& label : labels_)
+        label.address = SIZE_MAX;
+
+    char* output = bytecode_.data();
+    size_t address = 0;
+    size_t iDefinition = 0;
+
+    auto defineLabels = [&](size_t iInst) {
+        for (; iDefinition < definitions_.size() &&
+               labels_[definitions_[iDefinition]].iInst == iInst;
+             iDefinition++)
+            labels_[definitions_[iDefinition]].address = address;
+    };
+
+    for (size_t iInst = 0; iInst < instructions_.size(); iInst++) {
+        defineLabels(iInst);
+
+        Instruction& inst = instructions_[iInst];
+        long long offset = 0;
+
+        int argType = inst.GetArgType();
+        if (argType == LABEL || argType == WIDE_LABEL) {
+            size_t addressLabel = labels_[inst.GetLabelId()].address;
+            if (addressLabel == SIZE_MAX) {
+                fixups_.push_back(Fixup{iInst, address});
+            }
+            else {
+                offset = static_cast<long long>(addressLabel) -
+                         static_cast<long long>(address);
+                if (offset < INT32_MIN)
+                    throw std::runtime_error("Assembler: too big jump");
+                if (offset < SCHAR_MIN)
+                    inst.Widen();
+            }
+        }
 
-    std::string output;
-    size_t offset = 0;
+        address += inst.ConvertToByteCode(output + address, offset);
+    }
+    defineLabels(instructions_.size());
 
-    for (const auto& inst : instructions_) {
-        offset = output.size();
+    bool isResolved = true;
 
-        if (!inst.GetLabeled().empty())
-            labels_.at(inst.GetLabeled()).to = offset + 1;
+    for (const auto& fixup : fixups_) {
+        Instruction& inst = instructions_[fixup.iInst];
+        const Label& label = labels_[inst.GetLabelId()];
+        if (label.address == SIZE_MAX)
+            throw std::runtime_error("Assembler: Undefined label " +
+                                     std::string(label.name));
 
-        output += inst.ConvertToByteCode(labels_, offset);
-    }
+        long long offset = static_cast<long long>(label.address) -
+                           static_cast<long long>(fixup.address);
+        if (offset > INT32_MAX)
+            throw std::runtime_error("Assembler: too big jump");
 
-    for (const auto &inst : instructions_) {
-        if (inst.GetArgType() == LABEL) {
-            OffsetLabel& offsetLabel = labels_.at(inst.GetLabel());
-            int offset = offsetLabel.to - offsetLabel.froms.front();
-            if (offset > 128 || offset < -128)
-                throw std::runtime_error("Assembler: too big jump");
-            output[offsetLabel.froms.front()] = offset;
-            offsetLabel.froms.pop_front();
+        if (inst.GetArgType() == LABEL && offset > SCHAR_MAX) {
+            inst.Widen();
+            isResolved = false;
+        }
+        else {
+            inst.ConvertToByteCode(output + fixup.address, offset);
         }
     }
 
-    fwrite(output.c_str(), 1, output.size(), outputFile);
+    bytecode_.resize(address);
+    return isResolved;
+}
+
+void Assembler::WriteToFile() const
+{
+    FILE *outputFile = fopen(pathToOutputFile_.c_str(), "wb");
+
+    if (outputFile == nullptr)
+        throw std::runtime_error("Assembler: Can`t create output file");
+
+    fwrite(bytecode_.data(), 1, bytecode_.size(), outputFile);
 
     fclose(outputFile);
 }
@@ -117,11 +214,9 @@ void Assembler::Dump() const
 
     std::cerr << "\n#[Labels_Begin]\n";
     for (const auto& label : labels_) {
-        std::cerr << "\tLabel {" << label.first << "}\n"
-                  << "\t\tTo: " << label.second.to << "\n"
-                  << "\t\tFrom:\n";
-        for (const auto from : label.second.froms)
-            std::cerr << "\t\t" << from << "\n";
+        std::cerr << "\tLabel {" << label.name << "}\n"
+                  << "\t\tInstruction: " << label.iInst << "\n"
+                  << "\t\tAddress: " << label.address << "\n";
     }
     std::cerr << "#[Labels_End]\n";
 
@@ -1,9 +1,14 @@
 #ifndef BINARY_TRANSLATOR_ASSEMBLER_ASSEMBLER_H
 #define BINARY_TRANSLATOR_ASSEMBLER_ASSEMBLER_H
 
+#include "Bytecode.h"
 #include "Instruction.h"
+#include "MappedFile.h"
 
+#include <cstdint>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 namespace BinaryTranslator {
@@ -13,17 +18,54 @@ private:
     std::string pathToInputFile_;
     std::string pathToOutputFile_;
 
-    std::vector<std::string> instructionsText_;
+    // Instructions and labels refer to text of source_
+    MappedFile source_;
     std::vector<Instruction> instructions_;
-    std::map<std::string, OffsetLabel> labels_;
+
+    struct Label {
+        std::string_view name;
+        // Index of instruction marked by label, SIZE_MAX if it is undefined
+        size_t iInst = SIZE_MAX;
+        // Address in current pass of encoder, SIZE_MAX until label is met
+        size_t address = SIZE_MAX;
+    };
+
+    // Labels are interned, instructions refer to them by index in labels_
+    std::vector<Label> labels_;
+    std::unordered_map<std::string_view, uint32_t> labelIds_;
+    // Indices of labels in order of their definitions in source
+    std::vector<uint32_t> definitions_;
+
+    // Jump to a label which is not encoded yet
+    struct Fixup {
+        size_t iInst;
+        size_t address;
+    };
+
+    std::vector<Fixup> fixups_;
+
+    std::vector<char> bytecode_;
 
     void ReadFromFile();
-    void ConvertToByteCode();
+    void ParseSource(std::string_view text);
+    uint32_t InternLabel(std::string_view name);
+    void DefineLabel(std::string_view name);
+    bool ConvertToByteCode();
+    void WriteToFile() const;
 
 public:
+    // Assembler without files, only for Assemble(source)
+    Assembler() = default;
     Assembler(const char* pathToInputFile, const char* pathToOutputFile);
 
+    // Assembles input file into output file, bytecode stays in memory too
     void Assemble();
+    // Assembles source text in memory without touching files, Dump() refers
+    // to source, so it has to be called while source is alive
+    ByteSpan Assemble(std::string_view source);
+
+    // Bytecode of the last Assemble(), it lives as long as assembler
+    ByteSpan GetByteCode() const;
 
     void Dump() const;
 
@@ -32,4 +74,4 @@ public:
 
 } // namespace BinaryTranslator
 
-#endif // BINARY_TRANSLATOR_ASSEMBLER_ASSEMBLER_H
\ No newline at end of file
+#endif // BINARY_TRANSLATOR_ASSEMBLER_ASSEMBLER_H
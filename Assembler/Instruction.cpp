@@ -3,178 +3,326 @@
 
 #include "Constants.h"
 
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <climits>
+#include <cstdint>
 #include <iostream>
+#include <stdexcept>
 
 using namespace BinaryTranslator;
 
 namespace {
 
-const std::map<int, std::string> kRegisterList = { {EAX, "rax"},
-                                                   {EBX, "rbx"},
-                                                   {ECX, "rcx"},
-                                                   {EDX, "rdx"} };
+// Indexed by Registers
+constexpr std::array<std::string_view, N_REGS> kRegisterNames =
+    {"rax", "rbx", "rcx", "rdx"};
 
-int WhichReg(const std::string& instructionText, bool isFirstArg = true)
+const char kSeparators[] = " \t\r,";
+
+// Cuts the next word off the front of text
+std::string_view NextToken(std::string_view& text)
 {
-    char inputRegister[10] = {0};
-    if (isFirstArg)
-        sscanf(instructionText.c_str(), "%*s %[a-z 0-9]", inputRegister);
-    else
-        sscanf(instructionText.c_str(), "%*s %*s %s", inputRegister);
+    size_t begin = text.find_first_not_of(kSeparators);
+    if (begin == std::string_view::npos) {
+        text = {};
+        return {};
+    }
+
+    size_t end = text.find_first_of(kSeparators, begin);
+    if (end == std::string_view::npos)
+        end = text.size();
+
+    std::string_view token = text.substr(begin, end - begin);
+    text.remove_prefix(end);
+    return token;
+}
 
-    for (auto kRegister : kRegisterList)
-        if (inputRegister == kRegister.second)
-            return kRegister.first;
+int WhichReg(std::string_view token, std::string_view instructionText)
+{
+    for (int iReg = 0; iReg < N_REGS; iReg++)
+        if (token == kRegisterNames[iReg])
+            return iReg;
 
     throw std::runtime_error("Assembler: Unidentified register " +
-                             instructionText);
+                             std::string(instructionText));
 }
 
-}; // Anonymos namespace
+int WhichNumber(std::string_view token, std::string_view instructionText)
+{
+    if (!token.empty() && token.front() == '+')
+        token.remove_prefix(1);
+
+    int number = 0;
+    auto [end, error] =
+        std::from_chars(token.data(), token.data() + token.size(), number);
+    if (token.empty() || error != std::errc() ||
+        end != token.data() + token.size())
+        throw std::runtime_error("Assembler: Invalid number " +
+                                 std::string(instructionText));
+
+    return number;
+}
+
+struct Mnemonic {
+    std::string_view name;
+    int id;
+    int argType;
+};
 
-class Instruction::Impl {
-private:
-    int Id_ = -1;
-    int argType_ = -1;
+template <size_t N>
+constexpr std::array<Mnemonic, N>
+SortMnemonics(std::array<Mnemonic, N> mnemonics)
+{
+    for (size_t i = 1; i < N; i++)
+        for (size_t j = i; j > 0 && mnemonics[j].name < mnemonics[j - 1].name;
+             j--) {
+            Mnemonic temp = mnemonics[j];
+            mnemonics[j] = mnemonics[j - 1];
+            mnemonics[j - 1] = temp;
+        }
 
-    int arg1_ = 0;
-    int arg2_ = 0;
-    std::string label_;
-    std::string labeled_;
+    return mnemonics;
+}
 
-public:
-    Impl() = default;
+// Every instruction is in table once, table is sorted, so duplicates
+// are neighbours and missing entries of N_INST are empty names in front
+template <size_t N>
+constexpr bool IsValidMnemonics(const std::array<Mnemonic, N>& mnemonics)
+{
+    for (size_t i = 0; i < N; i++)
+        if (mnemonics[i].name.empty() ||
+            (i > 0 && mnemonics[i].name == mnemonics[i - 1].name))
+            return false;
 
-    void ParseArguments(const std::string& instructionText);
+    return true;
+}
 
-    friend class Instruction;
+// Mnemonics of Commands_DSL.txt sorted by name at compile time
+constexpr auto kMnemonics = SortMnemonics(std::array<Mnemonic, N_INST>{{
+    #define INSTRUCTION(name, id, argtype, num, size, code)  \
+        {#name, id, argtype},                                \
 
-}; //class Instruction::Impl
+    #define INSTRUCTIONS
+    #include "Commands_DSL.txt"
 
+    #undef INSTRUCTIONS
+    #undef INSTRUCTION
+}});
 
-Instruction::Instruction() : pImpl_(std::make_unique<Impl>()) {};
+static_assert(IsValidMnemonics(kMnemonics),
+              "Commands_DSL.txt: Every instruction needs unique mnemonic");
 
-Instruction::~Instruction() = default;
+const Mnemonic* FindMnemonic(std::string_view name)
+{
+    auto mnemonic =
+        std::lower_bound(kMnemonics.begin(), kMnemonics.end(), name,
+                         [](const Mnemonic& lhs, std::string_view rhs)
+                         { return lhs.name < rhs; });
 
-Instruction::Instruction(Instruction &&) = default;
+    if (mnemonic == kMnemonics.end() || mnemonic->name != name)
+        return nullptr;
 
-Instruction& Instruction::operator=(Instruction &&) = default;
+    return mnemonic;
+}
 
+int GetWideIdInstr(int idInstr)
+{
+    switch (idInstr) {
+    case JMP:  return JMP_W;
+    case CALL: return CALL_W;
+    case JG:   return JG_W;
+    case JGE:  return JGE_W;
+    case JL:   return JL_W;
+    case JLE:  return JLE_W;
+    case JE:   return JE_W;
+    case JNE:  return JNE_W;
+
+    case PUSH: return PUSH_W;
+    case MOV:  return MOV_W;
+    case ADD:  return ADD_W;
+    case SUB:  return SUB_W;
+    case IMUL: return IMUL_W;
+    case IDIV: return IDIV_W;
+    case CMP:  return CMP_W;
+
+    default:
+        return -1;
+    }
+}
 
-void Instruction::Impl::ParseArguments(const std::string& instructionText)
+// Writes number in little-endian order, returns the next byte
+char* WriteInt32(char* output, int32_t number)
+{
+    for (int iByte = 0; iByte < 4; iByte++)
+        *output++ = static_cast<uint32_t>(number) >> (8 * iByte);
+
+    return output;
+}
+
+#define INSTRUCTION(name, id, argtype, num, size, code)  \
+    static_assert(size <= MAX_SIZE_INSTR,                \
+                  "MAX_SIZE_INSTR is less than size of " #name);
+
+#define INSTRUCTIONS
+#include "Commands_DSL.txt"
+
+#undef INSTRUCTIONS
+#undef INSTRUCTION
+
+}; // Anonymos namespace
+
+void Instruction::ParseArguments(std::string_view arguments,
+                                 std::string_view instructionText)
 {
     switch (argType_) {
     case NOARG:
         return;
 
     case LABEL:
-        label_ = instructionText.substr(instructionText.find(" ") + 1);
+    case WIDE_LABEL:
+        label_ = NextToken(arguments);
+        if (label_.empty())
+            throw std::runtime_error("Assembler: Missing label " +
+                                     std::string(instructionText));
         return;
 
     case NUMBER:
-        sscanf(instructionText.c_str(), "%*s %d", &arg1_);
+    case WIDE_NUMBER:
+        arg1_ = WhichNumber(NextToken(arguments), instructionText);
         return;
 
     case REG:
-        arg1_ = WhichReg(instructionText);
+        arg1_ = WhichReg(NextToken(arguments), instructionText);
         return;
 
     case REG_REG:
-        arg1_ = WhichReg(instructionText);
-        arg2_ = WhichReg(instructionText, false);
+        arg1_ = WhichReg(NextToken(arguments), instructionText);
+        arg2_ = WhichReg(NextToken(arguments), instructionText);
         return;
 
-    case REG_NUMBER: {
-        arg1_ = WhichReg(instructionText);
-        sscanf(instructionText.c_str(), "%*s %*s %d", &arg2_);
+    case REG_NUMBER:
+    case REG_WIDE_NUMBER:
+        arg1_ = WhichReg(NextToken(arguments), instructionText);
+        arg2_ = WhichNumber(NextToken(arguments), instructionText);
         return;
     }
-    }
 }
 
 
-void Instruction::ParseInstruction(const std::string& instructionText)
+void Instruction::ParseInstruction(std::string_view instructionText)
 {
-    #define INSTRUCTION(name, id, argtype, num, size, code) {       \
-            if (instructionText.find(#name) != std::string::npos) { \
-                pImpl_->Id_ = id;                                   \
-                pImpl_->argType_ = argtype;                         \
-            }                                                       \
-        }
-
-    #define INSTRUCTIONS
-    #include "Commands_DSL.txt"
+    std::string_view arguments = instructionText;
+    const Mnemonic* mnemonic = FindMnemonic(NextToken(arguments));
 
-    #undef INSTRUCTIONS
+    if (mnemonic == nullptr)
+        throw std::runtime_error("Assembler: Unidentified instruction " +
+                                 std::string(instructionText));
 
-        if (pImpl_->Id_ == -1)
-            throw std::runtime_error("Assembler: Unidentified instruction" +
-                                    instructionText);
+    Id_ = mnemonic->id;
+    argType_ = mnemonic->argType;
 
-        pImpl_->ParseArguments(instructionText);
+    ParseArguments(arguments, instructionText);
 
-    #undef INSTRUCTION
+    // Numbers which do not fit in a signed byte need 32-bit immediate
+    int number = (argType_ == NUMBER) ? arg1_ : arg2_;
+    if ((argType_ == NUMBER || argType_ == REG_NUMBER) &&
+        (number > SCHAR_MAX || number < SCHAR_MIN))
+        Widen();
 }
 
 
 void Instruction::Dump() const
 {
-    std::cout << "Id ["       << std::hex << pImpl_->Id_      << "],"
-              << "ArgType ["              << pImpl_->argType_ << "]\n"
-              << "\tArg_1 ["  << std::hex << pImpl_->arg1_    << "]"
-              << "Arg_2 ["    << std::hex << pImpl_->arg2_    << "]\n"
-              << "\tlabel: {"             << pImpl_->label_   << "}\n\n";
+    std::cout << "Id ["       << std::hex << Id_      << "],"
+              << "ArgType ["              << argType_ << "]\n"
+              << "\tArg_1 ["  << std::hex << arg1_    << "]"
+              << "Arg_2 ["    << std::hex << arg2_    << "]\n"
+              << "\tlabel: {"             << label_   << "}\n\n";
 }
 
 
-std::string
-Instruction::ConvertToByteCode(std::map<std::string, OffsetLabel>& labels,
-                               int offset) const
+size_t Instruction::ConvertToByteCode(char* output, int offsetLabel) const
 {
-    std::string output;
-    output += pImpl_->Id_;
+    char* byte = output;
+    *byte++ = Id_;
 
-    switch (pImpl_->argType_) {
+    switch (argType_) {
     case NOARG:
         break;
 
     case REG_NUMBER:
     case REG_REG:
-        output += pImpl_->arg1_;
-        output += pImpl_->arg2_;
+        *byte++ = arg1_;
+        *byte++ = arg2_;
         break;
 
     case NUMBER:
     case REG:
-        output += pImpl_->arg1_;
+        *byte++ = arg1_;
+        break;
+
+    case REG_WIDE_NUMBER:
+        *byte++ = arg1_;
+        byte = WriteInt32(byte, arg2_);
+        break;
+
+    case WIDE_NUMBER:
+        byte = WriteInt32(byte, arg1_);
         break;
 
     case LABEL:
-        output += 1;
-        labels.at(pImpl_->label_).froms.push_back(offset + 1);
+        *byte++ = offsetLabel;
+        break;
+
+    case WIDE_LABEL:
+        byte = WriteInt32(byte, offsetLabel);
         break;
     }
 
-    return output;
+    return byte - output;
 }
 
+bool Instruction::Widen()
+{
+    int idWide = GetWideIdInstr(Id_);
+    if (idWide == -1)
+        return false;
+
+    Id_ = idWide;
+    switch (argType_) {
+    case LABEL:
+        argType_ = WIDE_LABEL;
+        break;
+
+    case NUMBER:
+        argType_ = WIDE_NUMBER;
+        break;
+
+    case REG_NUMBER:
+        argType_ = REG_WIDE_NUMBER;
+        break;
+    }
+    return true;
+}
 
 int Instruction::GetArgType() const
 {
-    return pImpl_->argType_;
+    return argType_;
 }
 
-std::string Instruction::GetLabel() const
+std::string_view Instruction::GetLabel() const
 {
-    return pImpl_->label_;
+    return label_;
 }
 
-std::string Instruction::GetLabeled() const
+uint32_t Instruction::GetLabelId() const
 {
-    return pImpl_->labeled_;
+    return labelId_;
 }
 
-void Instruction::SetLabeled(const std::string &labeled)
+void Instruction::SetLabelId(uint32_t labelId)
 {
-    pImpl_->labeled_ = labeled;
+    labelId_ = labelId;
 }
\ No newline at end of file
@@ -1,43 +1,43 @@
 #ifndef BINARY_TRANSLATOR_ASSEMBLER_INSTRUCTION_H
 #define BINARY_TRANSLATOR_ASSEMBLER_INSTRUCTION_H
 
-#include <deque>
-#include <experimental/propagate_const>
-#include <map>
-#include <memory>
+#include <cstdint>
+#include <string_view>
 
 namespace BinaryTranslator {
 
-struct OffsetLabel {
-    std::deque<size_t> froms;
-    size_t to;
-};
-
+// Instruction is a small value stored in a flat array, its label is
+// a view into source text which has to outlive it
 class Instruction {
 private:
-    class Impl;
-    std::experimental::propagate_const<std::unique_ptr<Impl>> pImpl_;
+    int Id_ = -1;
+    int argType_ = -1;
 
-public:
-    Instruction();
+    int arg1_ = 0;
+    int arg2_ = 0;
+    std::string_view label_;
+    // Index of interned label_ in Assembler
+    uint32_t labelId_ = 0;
 
-    Instruction(const Instruction&) = delete;
-    Instruction& operator=(const Instruction&) = delete;
-    Instruction(Instruction&&);
-    Instruction& operator=(Instruction&&);
+    void ParseArguments(std::string_view arguments,
+                        std::string_view instructionText);
 
-    ~Instruction();
+public:
+    void ParseInstruction(std::string_view instructionText);
 
-    void ParseInstruction(const std::string &instructionText);
+    // Writes instruction to output, offsetLabel is distance from this
+    // instruction to its label. Returns number of written bytes.
+    size_t ConvertToByteCode(char* output, int offsetLabel) const;
 
-    std::string ConvertToByteCode(std::map<std::string, OffsetLabel> &labels,
-                                  int offset) const;
+    // Switches jump or call to 32-bit offset and instruction with number to
+    // 32-bit immediate, returns false if it has no wider encoding
+    bool Widen();
 
-    int         GetArgType() const;
-    std::string GetLabel()   const;
-    std::string GetLabeled() const;
+    int              GetArgType() const;
+    std::string_view GetLabel()   const;
+    uint32_t         GetLabelId() const;
 
-    void SetLabeled(const std::string &labeled);
+    void SetLabelId(uint32_t labelId);
 
     void Dump() const;
 
@@ -45,4 +45,4 @@ public:
 
 } //namespace BinaryTranslator
 
-#endif // BINARY_TRANSLATOR_ASSEMBLER_INSTRUCTION_H
\ No newline at end of file
+#endif // BINARY_TRANSLATOR_ASSEMBLER_INSTRUCTION_H
@@ -0,0 +1,96 @@
+#ifndef BINARY_TRANSLATOR_ASSEMBLER_MAPPEDFILE_H
+#define BINARY_TRANSLATOR_ASSEMBLER_MAPPEDFILE_H
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace BinaryTranslator {
+
+// Read-only mapping of source file: parser takes views of its text
+// instead of copying lines, so mapping has to outlive them
+class MappedFile {
+private:
+    void* data_ = nullptr;
+    size_t size_ = 0;
+
+    void Unmap()
+    {
+        if (data_ != nullptr)
+            munmap(data_, size_);
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+public:
+    MappedFile() = default;
+
+    explicit MappedFile(const std::string& path)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd == -1)
+            throw std::runtime_error("Assembler: Invalid path to file");
+
+        struct stat fileStat;
+        if (fstat(fd, &fileStat) == -1) {
+            close(fd);
+            throw std::runtime_error("Assembler: Can`t read " + path);
+        }
+
+        size_ = fileStat.st_size;
+        if (size_ != 0) {
+            data_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data_ == MAP_FAILED) {
+                data_ = nullptr;
+                size_ = 0;
+                close(fd);
+                throw std::runtime_error("Assembler: Can`t map " + path);
+            }
+            madvise(data_, size_, MADV_SEQUENTIAL);
+        }
+
+        close(fd);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& other) noexcept :
+        data_(other.data_),
+        size_(other.size_)
+    {
+        other.data_ = nullptr;
+        other.size_ = 0;
+    }
+
+    MappedFile& operator=(MappedFile&& other) noexcept
+    {
+        if (this != &other) {
+            Unmap();
+            data_ = other.data_;
+            size_ = other.size_;
+            other.data_ = nullptr;
+            other.size_ = 0;
+        }
+        return *this;
+    }
+
+    ~MappedFile()
+    {
+        Unmap();
+    }
+
+    std::string_view GetText() const
+    {
+        return {static_cast<const char*>(data_), size_};
+    }
+}; // class MappedFile
+
+} // namespace BinaryTranslator
+
+#endif // BINARY_TRANSLATOR_ASSEMBLER_MAPPEDFILE_H
@@ -0,0 +1,315 @@
+#include "Assembler.h"
+#include "Runtime.h"
+#include "Simulator.h"
+#include "Translator.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// End-to-end benchmark of engines: every program is assembled once and run
+// from scratch by CPU-Simulator, unoptimized and optimized JIT for each
+// length of input array. Time of JIT includes translation and compilation.
+// Programs which read input get the same input file on every run.
+
+using namespace BinaryTranslator;
+
+namespace {
+
+const char kUsage[] = "Usage: Benchmark [--runs=<N>] [--warmup=<N>] "
+                      "[--sizes=<N>,<N>,...] [--input=<file>] "
+                      "[<program.txt> ...]\n";
+
+const unsigned DEFAULT_RUNS = 5;
+const unsigned DEFAULT_WARMUP = 1;
+
+const char* const kDefaultPrograms[] = {
+    BENCHMARK_PROGRAMS_DIR "/benchmark.txt",
+    BENCHMARK_PROGRAMS_DIR "/benchmark_opt.txt",
+};
+
+const size_t kDefaultSizes[] = {
+    SIZE_MEMORY_BENCHMARK / 4,
+    SIZE_MEMORY_BENCHMARK / 2,
+    SIZE_MEMORY_BENCHMARK,
+};
+
+struct Options {
+    unsigned nRuns = DEFAULT_RUNS;
+    unsigned nWarmup = DEFAULT_WARMUP;
+    std::vector<size_t> sizes;
+    // Stdin of every run, programs which read input need it
+    std::string inputPath;
+    std::vector<std::string> programs;
+};
+
+enum Engines {
+    ENGINE_SIMULATOR,
+    ENGINE_JIT_O0,
+    ENGINE_JIT_O2,
+    N_ENGINES,
+};
+
+const char* const kEngineNames[N_ENGINES] = {
+    "Simulator",
+    "JIT -O0",
+    "JIT -O2",
+};
+
+[[noreturn]] void ExitWithUsage(const std::string& message)
+{
+    std::cerr << "Error: " << message << "\n" << kUsage;
+    exit(EXIT_FAILURE);
+}
+
+std::vector<size_t> ParseSizes(const char* list)
+{
+    std::vector<size_t> sizes;
+    std::stringstream stream(list);
+    for (std::string item; std::getline(stream, item, ',');) {
+        long long size = atoll(item.c_str());
+        if (size <= 0 || static_cast<size_t>(size) > SIZE_MEMORY_BENCHMARK)
+            ExitWithUsage("Size of input has to be in [1, " +
+                          std::to_string(SIZE_MEMORY_BENCHMARK) + "]");
+        sizes.push_back(size);
+    }
+    return sizes;
+}
+
+Options ParseOptions(int argc, char** argv)
+{
+    Options options;
+
+    for (int iArg = 1; iArg < argc; iArg++) {
+        const char* option = argv[iArg];
+
+        if (!strncmp(option, "--runs=", 7) && atoi(option + 7) > 0)
+            options.nRuns = atoi(option + 7);
+        else if (!strncmp(option, "--warmup=", 9) && atoi(option + 9) >= 0)
+            options.nWarmup = atoi(option + 9);
+        else if (!strncmp(option, "--sizes=", 8))
+            options.sizes = ParseSizes(option + 8);
+        else if (!strncmp(option, "--input=", 8) && option[8] != '\0')
+            options.inputPath = option + 8;
+        else if (!strncmp(option, "--", 2))
+            ExitWithUsage(std::string("Unknown option ") + option);
+        else
+            options.programs.push_back(option);
+    }
+
+    if (options.sizes.empty())
+        options.sizes.assign(std::begin(kDefaultSizes), std::end(kDefaultSizes));
+    if (options.programs.empty())
+        options.programs.assign(std::begin(kDefaultPrograms),
+                                std::end(kDefaultPrograms));
+
+    return options;
+}
+
+std::string ReadSource(const std::string& path)
+{
+    std::ifstream file(path);
+    if (!file)
+        throw std::runtime_error("Benchmark: Can`t read " + path);
+
+    std::stringstream source;
+    source << file.rdbuf();
+    return source.str();
+}
+
+// Program reads input if it has read or read_p anywhere in its bytecode
+bool IsReadingInput(ByteSpan bytecode)
+{
+    for (size_t PC = 0; PC < bytecode.size;) {
+        int idInstr = static_cast<unsigned char>(bytecode.data[PC]);
+        if (idInstr == READ || idInstr == READ_P)
+            return true;
+
+        size_t sizeInstr = 0;
+        #define INSTRUCTION(name, id, argType, num, size, code)  \
+            case id: sizeInstr = size; break;                    \
+
+        #define INSTRUCTIONS
+        switch (idInstr) {
+        #include "Commands_DSL.txt"
+        }
+        #undef INSTRUCTIONS
+        #undef INSTRUCTION
+
+        if (sizeInstr == 0)
+            break;
+        PC += sizeInstr;
+    }
+
+    return false;
+}
+
+// Every run reads input from its beginning, otherwise the runs after the
+// first one get EOF
+void RewindInput(const std::string& inputPath)
+{
+    if (inputPath.empty())
+        return;
+
+    if (freopen(inputPath.c_str(), "r", stdin) == nullptr)
+        throw std::runtime_error("Benchmark: Can`t read " + inputPath);
+}
+
+// Guest programs write to stdout through Runtime, it goes to /dev/null
+// while they run
+class SilentStdout {
+private:
+    int savedFd_ = -1;
+
+public:
+    SilentStdout()
+    {
+        fflush(stdout);
+        savedFd_ = dup(STDOUT_FILENO);
+
+        int nullFd = open("/dev/null", O_WRONLY);
+        if (nullFd != -1) {
+            dup2(nullFd, STDOUT_FILENO);
+            close(nullFd);
+        }
+    }
+
+    SilentStdout(const SilentStdout&) = delete;
+    SilentStdout& operator=(const SilentStdout&) = delete;
+
+    ~SilentStdout()
+    {
+        RuntimeFlush();
+        if (savedFd_ != -1) {
+            dup2(savedFd_, STDOUT_FILENO);
+            close(savedFd_);
+        }
+    }
+}; // class SilentStdout
+
+void RunEngine(int engine, ByteSpan bytecode, size_t sizeBenchmark)
+{
+    switch (engine) {
+    case ENGINE_SIMULATOR: {
+        SimulatorConfig config;
+        config.isAnalyse = true;
+        config.sizeBenchmark = sizeBenchmark;
+
+        CpuSimulator cpuSimulator(config);
+        cpuSimulator.Run(bytecode);
+        break;
+    }
+
+    case ENGINE_JIT_O0:
+    case ENGINE_JIT_O2: {
+        Translator translator(bytecode, true, false, sizeBenchmark);
+        translator.Translate();
+        translator.Optimize(engine == ENGINE_JIT_O2 ? 2 : 0);
+        translator.Run();
+        break;
+    }
+    }
+}
+
+double MeasureRun(int engine, ByteSpan bytecode, size_t sizeBenchmark,
+                  const std::string& inputPath)
+{
+    RewindInput(inputPath);
+    SilentStdout silentStdout;
+
+    auto start = std::chrono::steady_clock::now();
+    RunEngine(engine, bytecode, sizeBenchmark);
+    auto end = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// Linear interpolation between the closest ranks of sorted samples
+double GetPercentile(const std::vector<double>& sorted, double percent)
+{
+    double rank = percent / 100 * (sorted.size() - 1);
+    size_t lower = static_cast<size_t>(std::floor(rank));
+    size_t upper = std::min(lower + 1, sorted.size() - 1);
+
+    return sorted[lower] + (sorted[upper] - sorted[lower]) * (rank - lower);
+}
+
+struct Timings {
+    double median = 0;
+    double p10 = 0;
+    double p90 = 0;
+};
+
+Timings MeasureEngine(int engine, ByteSpan bytecode, size_t sizeBenchmark,
+                      const Options& options)
+{
+    for (unsigned iRun = 0; iRun < options.nWarmup; iRun++)
+        MeasureRun(engine, bytecode, sizeBenchmark, options.inputPath);
+
+    std::vector<double> samples;
+    for (unsigned iRun = 0; iRun < options.nRuns; iRun++)
+        samples.push_back(MeasureRun(engine, bytecode, sizeBenchmark,
+                                     options.inputPath));
+    std::sort(samples.begin(), samples.end());
+
+    return {GetPercentile(samples, 50), GetPercentile(samples, 10),
+            GetPercentile(samples, 90)};
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv)
+{
+    Options options = ParseOptions(argc, argv);
+
+    printf("Runs: %u (+%u warmup), time of JIT includes translation and "
+           "compilation\n\n", options.nRuns, options.nWarmup);
+    printf("%-20s %6s  %-10s %12s %12s %12s %9s\n", "Program", "Size",
+           "Engine", "Median, ms", "P10, ms", "P90, ms", "Speedup");
+
+    for (const std::string& program : options.programs) {
+        try {
+            // Labels of Dump() refer to source, so it outlives assembler
+            std::string source = ReadSource(program);
+            Assembler assembler;
+            ByteSpan bytecode = assembler.Assemble(source);
+            if (options.inputPath.empty() && IsReadingInput(bytecode))
+                throw std::runtime_error("Benchmark: " + program + " reads "
+                                         "input, give it with --input=<file>");
+
+            std::string name = program.substr(program.find_last_of('/') + 1);
+            for (size_t sizeBenchmark : options.sizes) {
+                Timings timings[N_ENGINES];
+                for (int engine = 0; engine < N_ENGINES; engine++) {
+                    timings[engine] = MeasureEngine(engine, bytecode,
+                                                    sizeBenchmark, options);
+
+                    printf("%-20s %6zu  %-10s %12.3f %12.3f %12.3f %8.2fx\n",
+                           name.c_str(), sizeBenchmark, kEngineNames[engine],
+                           timings[engine].median, timings[engine].p10,
+                           timings[engine].p90,
+                           timings[ENGINE_SIMULATOR].median /
+                               timings[engine].median);
+                    fflush(stdout);
+                }
+            }
+        }
+        catch (std::exception& exception) {
+            std::cerr << exception.what() << "\n";
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    return 0;
+}
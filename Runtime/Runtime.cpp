@@ -0,0 +1,266 @@
+#include "Runtime.h"
+
+#include "Bytecode.h"
+#include "Constants.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <utility>
+#include <vector>
+
+using namespace BinaryTranslator;
+
+namespace {
+
+const size_t SIZE_OUTPUT_BUFFER = 1 << 16;
+// Enough for "-2147483648\n"
+const size_t MAX_SIZE_NUMBER = 12;
+
+char outputBuffer[SIZE_OUTPUT_BUFFER];
+size_t sizeOutput = 0;
+
+// Output written before exit() of host process is not lost
+struct FlushAtExit {
+    ~FlushAtExit()
+    {
+        RuntimeFlush();
+    }
+} flushAtExit;
+
+// Number of the hottest blocks and call targets in profile
+const size_t N_HOT_ENTRIES = 10;
+
+struct Profile {
+    const unsigned char* bytecode = nullptr;
+    size_t sizeByteCode = 0;
+    const uint64_t* counts = nullptr;
+    bool isPrinted = true;
+    // Executions of each instruction and total of them at the last report,
+    // counters may be gone by the time they are read
+    uint64_t nExecutions[N_INST + 1] = {};
+} profile;
+
+struct InstrInfo {
+    const char* name = nullptr;
+    int num = 0;
+    int argType = NOARG;
+    size_t size = 0;
+};
+
+// Size is 0 for unknown instruction
+InstrInfo GetInstrInfo(int idInstr)
+{
+    #define INSTRUCTION(name, id, argType, num, size, code)  \
+        case id: return {#name, num, argType, size};         \
+
+    #define INSTRUCTIONS
+    switch (idInstr) {
+    #include "Commands_DSL.txt"
+
+    default:
+        return {};
+    }
+
+    #undef INSTRUCTIONS
+    #undef INSTRUCTION
+}
+
+// Leaders of basic blocks by the rule of Translator: the first instruction,
+// targets of jumps and calls and instructions after jumps, ret and exit
+std::vector<bool> FindLeaders()
+{
+    std::vector<bool> isLeader(profile.sizeByteCode + 1, false);
+    isLeader[0] = true;
+
+    for (size_t PC = 0; PC < profile.sizeByteCode;) {
+        int idInstr = profile.bytecode[PC];
+        InstrInfo info = GetInstrInfo(idInstr);
+        if (info.size == 0 || PC + info.size > profile.sizeByteCode)
+            break;
+
+        if (info.argType == LABEL || info.argType == WIDE_LABEL) {
+            size_t targetPC = PC + GetLabelOffset(profile.bytecode + PC,
+                                                  info.argType);
+            if (targetPC < profile.sizeByteCode)
+                isLeader[targetPC] = true;
+            if (idInstr != CALL && idInstr != CALL_W)
+                isLeader[PC + info.size] = true;
+        }
+        if (idInstr == RET || idInstr == EXIT)
+            isLeader[PC + info.size] = true;
+
+        PC += info.size;
+    }
+
+    return isLeader;
+}
+
+void PrintHottest(const char* title,
+                  std::vector<std::pair<uint64_t, size_t>>& entries)
+{
+    size_t nPrinted = std::min(entries.size(), N_HOT_ENTRIES);
+    std::partial_sort(entries.begin(), entries.begin() + nPrinted,
+                      entries.end(),
+                      [](const auto& lhs, const auto& rhs) {
+                          return lhs.first > rhs.first;
+                      });
+
+    printf("\n%s:\n", title);
+    for (size_t i = 0; i < nPrinted; i++)
+        printf("\tPC %zu - %" PRIu64 "\n", entries[i].second, entries[i].first);
+}
+
+} // anonymous namespace
+
+extern "C" {
+
+void RuntimeWrite(int value)
+{
+    if (sizeOutput + MAX_SIZE_NUMBER > SIZE_OUTPUT_BUFFER)
+        RuntimeFlush();
+
+    char digits[MAX_SIZE_NUMBER];
+    char* end = digits + MAX_SIZE_NUMBER;
+    char* begin = end;
+
+    *--begin = '\n';
+
+    // Unsigned magnitude keeps INT_MIN representable
+    unsigned magnitude = (value < 0) ? 0u - static_cast<unsigned>(value)
+                                     : static_cast<unsigned>(value);
+    do {
+        *--begin = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude != 0);
+
+    if (value < 0)
+        *--begin = '-';
+
+    memcpy(outputBuffer + sizeOutput, begin, end - begin);
+    sizeOutput += end - begin;
+}
+
+int RuntimeRead()
+{
+    RuntimeFlush();
+
+    int value = 0;
+    if (scanf("%d", &value) != 1)
+        return 0;
+
+    return value;
+}
+
+void RuntimeFlush()
+{
+    if (sizeOutput != 0)
+        fwrite(outputBuffer, 1, sizeOutput, stdout);
+    sizeOutput = 0;
+
+    fflush(stdout);
+}
+
+void RuntimeStackOverflow()
+{
+    fputs("Runtime: Stack overflow\n", stderr);
+    exit(EXIT_FAILURE);
+}
+
+void RuntimeStackUnderflow()
+{
+    fputs("Runtime: Stack underflow\n", stderr);
+    exit(EXIT_FAILURE);
+}
+
+void RuntimeInvalidAddress(int address)
+{
+    fprintf(stderr, "Runtime: Invalid memory address %d\n", address);
+    exit(EXIT_FAILURE);
+}
+
+void RuntimeStartProfile(const char* bytecode, size_t sizeByteCode,
+                         const uint64_t* counts)
+{
+    profile.bytecode = reinterpret_cast<const unsigned char*>(bytecode);
+    profile.sizeByteCode = sizeByteCode;
+    profile.counts = counts;
+}
+
+// Every instruction of block is executed as many times as the block, calls
+// inside of it are counted for their targets
+void RuntimeReportProfile()
+{
+    if (profile.counts == nullptr)
+        return;
+
+    RuntimeFlush();
+
+    std::vector<bool> isLeader = FindLeaders();
+    uint64_t* nExecutions = profile.nExecutions;
+    std::fill(nExecutions, nExecutions + N_INST + 1, 0);
+    std::vector<std::pair<uint64_t, size_t>> blocks;
+    std::map<size_t, uint64_t> calls;
+
+    uint64_t count = 0;
+    for (size_t PC = 0; PC < profile.sizeByteCode;) {
+        int idInstr = profile.bytecode[PC];
+        InstrInfo info = GetInstrInfo(idInstr);
+        if (info.size == 0 || PC + info.size > profile.sizeByteCode)
+            break;
+
+        if (isLeader[PC]) {
+            count = profile.counts[PC];
+            if (count != 0)
+                blocks.push_back({count, PC});
+        }
+
+        nExecutions[info.num] += count;
+        nExecutions[N_INST] += count;
+        if ((idInstr == CALL || idInstr == CALL_W) && count != 0)
+            calls[PC + GetLabelOffset(profile.bytecode + PC, info.argType)] +=
+                count;
+
+        PC += info.size;
+    }
+
+    if (!profile.isPrinted)
+        return;
+
+    printf("\n[Profile]\nExecutions of each instruction:\n");
+    #define INSTRUCTION(name, id, argType, num, size, code)  \
+        printf("\t%s - %" PRIu64 "\n", #name, nExecutions[num]);  \
+
+    #define INSTRUCTIONS
+    #include "Commands_DSL.txt"
+
+    #undef INSTRUCTIONS
+    #undef INSTRUCTION
+    printf("\n\tTotal amount of instructions - %" PRIu64 "\n",
+           nExecutions[N_INST]);
+
+    PrintHottest("Hottest basic blocks", blocks);
+
+    std::vector<std::pair<uint64_t, size_t>> targets;
+    for (auto [targetPC, nCalls] : calls)
+        targets.push_back({nCalls, targetPC});
+    PrintHottest("Hottest call targets", targets);
+
+    printf("\n[End!]\n");
+    fflush(stdout);
+}
+
+void RuntimeSetProfilePrinted(bool isPrinted)
+{
+    profile.isPrinted = isPrinted;
+}
+
+uint64_t RuntimeGetProfileCount(int num)
+{
+    return (num >= 0 && num <= N_INST) ? profile.nExecutions[num] : 0;
+}
+
+} // extern "C"
@@ -0,0 +1,50 @@
+#ifndef BINARY_TRANSLATOR_RUNTIME_RUNTIME_H
+#define BINARY_TRANSLATOR_RUNTIME_RUNTIME_H
+
+// I/O of guest programs shared by CPU-Simulator and translated code.
+// Output is collected in one big buffer and written to stdout in bulk:
+// when buffer is full, before reading input and on exit of guest program.
+
+#include <cstddef>
+#include <cstdint>
+
+extern "C" {
+
+// Writes value and '\n'
+void RuntimeWrite(int value);
+
+// Reads number from stdin, 0 if there is no number
+int RuntimeRead();
+
+void RuntimeFlush();
+
+// Guest stack of translated code is full or empty: reports it as
+// CPU-Simulator does and terminates guest program
+void RuntimeStackOverflow();
+void RuntimeStackUnderflow();
+
+// Translated code accesses guest memory out of its bounds: reports address
+// as CPU-Simulator does and terminates guest program
+void RuntimeInvalidAddress(int address);
+
+// Block-level profile of guest program: counts[PC] is number of executions
+// of basic block which starts at PC, counters of other PCs are ignored.
+// Bytecode and counts are read at report, so they have to outlive it.
+void RuntimeStartProfile(const char* bytecode, size_t sizeByteCode,
+                         const uint64_t* counts);
+
+// Expands counts of blocks into executions of each instruction and prints
+// them with the hottest blocks and call targets by guest PC
+void RuntimeReportProfile();
+
+// Profile is printed on report by default. Counts of the last report are
+// kept for RuntimeGetProfileCount() anyway.
+void RuntimeSetProfilePrinted(bool isPrinted);
+
+// Executions of instruction with number num of NumInstructions, N_INST for
+// total of all instructions, counted by the last report of profile
+uint64_t RuntimeGetProfileCount(int num);
+
+} // extern "C"
+
+#endif // BINARY_TRANSLATOR_RUNTIME_RUNTIME_H
@@ -0,0 +1,79 @@
+#ifndef BINARY_TRANSLATOR_SIMULATOR_FIXEDSTACK_H
+#define BINARY_TRANSLATOR_SIMULATOR_FIXEDSTACK_H
+
+#include <memory>
+#include <stdexcept>
+
+namespace BinaryTranslator {
+
+// Stack of guest values in one preallocated buffer: push/pop never touch
+// the heap and overflow/underflow are reported as simulator errors
+template <typename T>
+class FixedStack {
+private:
+    std::unique_ptr<T[]> data_;
+    size_t capacity_ = 0;
+    size_t size_ = 0;
+
+public:
+    explicit FixedStack(size_t capacity) :
+        data_(std::make_unique<T[]>(capacity)),
+        capacity_(capacity)
+        {}
+
+    void push(const T& value)
+    {
+        if (size_ == capacity_)
+            throw std::runtime_error("Simulator: Stack overflow");
+        data_[size_++] = value;
+    }
+
+    void pop()
+    {
+        if (size_ == 0)
+            throw std::runtime_error("Simulator: Stack underflow");
+        size_--;
+    }
+
+    const T& top() const
+    {
+        if (size_ == 0)
+            throw std::runtime_error("Simulator: Stack underflow");
+        return data_[size_ - 1];
+    }
+
+    size_t size() const
+    {
+        return size_;
+    }
+
+    bool empty() const
+    {
+        return size_ == 0;
+    }
+
+    void clear()
+    {
+        size_ = 0;
+    }
+
+    // Native code of tiered execution pushes and pops in place
+    T* data()
+    {
+        return data_.get();
+    }
+
+    size_t* sizeAddress()
+    {
+        return &size_;
+    }
+
+    size_t capacity() const
+    {
+        return capacity_;
+    }
+}; // class FixedStack
+
+} // namespace BinaryTranslator
+
+#endif // BINARY_TRANSLATOR_SIMULATOR_FIXEDSTACK_H
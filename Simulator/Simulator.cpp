@@ -1,15 +1,244 @@
 #include "Simulator.h"
 #include "Assembler.h"
+#include "Bytecode.h"
+#include "Runtime.h"
+
+#include <algorithm>
+#include <climits>
 
 
 using namespace BinaryTranslator;
 
+namespace {
+
+size_t GetSizeInstr(int idInstr)
+{
+    #define INSTRUCTION(name, id, argType, num, size, code)  \
+        case id: return size;                                \
+
+    #define INSTRUCTIONS
+    switch (idInstr) {
+    #include "Commands_DSL.txt"
+
+    default:
+        return 0;
+    }
+
+    #undef INSTRUCTIONS
+    #undef INSTRUCTION
+}
+
+int GetArgtypeInstr(int idInstr)
+{
+    #define INSTRUCTION(name, id, argType, num, size, code)  \
+        case id: return argType;                             \
+
+    #define INSTRUCTIONS
+    switch (idInstr) {
+    #include "Commands_DSL.txt"
+
+    default:
+        return NOARG;
+    }
+
+    #undef INSTRUCTIONS
+    #undef INSTRUCTION
+}
+
+} // anonymous namespace
+
 void CpuSimulator::Run(char* const pathToInputFile)
 {
     ReadBytecode(pathToInputFile);
+    Execute();
+}
+
+void CpuSimulator::Run(ByteSpan bytecode)
+{
+    sizeByteCode_ = bytecode.size;
+    AllocByteCodeBuf(sizeByteCode_);
+    std::copy(bytecode.data, bytecode.data + bytecode.size, bytecode_);
+    Execute();
+}
+
+void CpuSimulator::Execute()
+{
+    CheckRegisters();
+    ResetState();
+    PrepareBenchmark();
+    AttachTierUp();
+
+    bool isProfiled = isProfile_ && tierUp_ == nullptr;
+    if (isProfiled) {
+        profile_.assign(sizeByteCode_ + 1, 0);
+        RuntimeStartProfile(bytecode_, sizeByteCode_, profile_.data());
+    }
+
+    switch (dispatch_) {
+    case DISPATCH_SWITCH:
+        if (tierUp_ != nullptr)
+            RunSwitch<true, false>();
+        else if (isProfiled)
+            RunSwitch<false, true>();
+        else
+            RunSwitch<false, false>();
+        break;
+
+    case DISPATCH_THREADED:
+        if (tierUp_ != nullptr)
+            RunThreaded<true, false>();
+        else if (isProfiled)
+            RunThreaded<false, true>();
+        else
+            RunThreaded<false, false>();
+        break;
+
+    // Micro-ops have no PCs to count hotness and executions of, so tiered
+    // and profiled execution interprets raw bytecode
+    case DISPATCH_PREDECODED:
+        if (tierUp_ != nullptr)
+            RunThreaded<true, false>();
+        else if (isProfiled)
+            RunThreaded<false, true>();
+        else
+            RunPredecoded();
+        break;
 
+    default:
+        throw std::runtime_error
+            ("Simulator: Unknown dispatch " + std::to_string(dispatch_));
+    }
+
+    if (isProfiled)
+        RuntimeReportProfile();
+}
+
+// Every Run() starts from a clean guest, nothing is left from the previous
+// program run by the same simulator
+void CpuSimulator::ResetState()
+{
+    std::fill(std::begin(registers_), std::end(registers_), 0);
+    std::fill(memory_.begin(), memory_.end(), 0);
+    stack_.clear();
+    callerStack_.clear();
+    isFlag = 0;
+    PC = 0;
+}
+
+// Raw bytecode engines index registers with operands as they are, so
+// registers of every instruction are checked once before them as
+// DecodeOperands() does for micro-ops
+void CpuSimulator::CheckRegisters() const
+{
+    for (size_t PC = 0; PC < sizeByteCode_;) {
+        int idInstr = (unsigned char)bytecode_[PC];
+        size_t sizeInstr = GetSizeInstr(idInstr);
+        if (sizeInstr == 0 || PC + sizeInstr > sizeByteCode_)
+            break;
+
+        unsigned char reg1 = 0;
+        unsigned char reg2 = 0;
+        switch (GetArgtypeInstr(idInstr)) {
+        case REG_REG:
+            reg2 = bytecode_[PC + 2];
+            [[fallthrough]];
+        case REG:
+        case REG_NUMBER:
+        case REG_WIDE_NUMBER:
+            reg1 = bytecode_[PC + 1];
+            break;
+        }
+
+        if (reg1 >= N_REGS || reg2 >= N_REGS)
+            throw std::runtime_error("Simulator: Undefined register at PC " +
+                                     std::to_string(PC));
+        PC += sizeInstr;
+    }
+}
+
+void CpuSimulator::AttachTierUp()
+{
+    if (tierUp_ == nullptr)
+        return;
+
+    hotness_.assign(sizeByteCode_ + 1, 0);
+    tiers_.assign(sizeByteCode_ + 1, TIER_INTERPRETED);
+
+    tierUp_->Attach({bytecode_, sizeByteCode_},
+                    {registers_, &isFlag, memory_.data(), memory_.size(),
+                     stack_.data(), stack_.sizeAddress(), stack_.capacity(),
+                     callerStack_.sizeAddress(), callerStack_.capacity()});
+}
+
+// Counts execution of call target or loop header and runs its native code
+// once it is hot enough and compiled
+int CpuSimulator::EnterNative(size_t targetPC)
+{
+    unsigned char& tier = tiers_[targetPC];
+    if (tier == TIER_INTERPRETED) {
+        if (++hotness_[targetPC] < tierUpThreshold_)
+            return NATIVE_NONE;
+        tier = tierUp_->Compile(targetPC) ? TIER_NATIVE : TIER_NO_NATIVE;
+    }
+
+    if (tier != TIER_NATIVE)
+        return NATIVE_NONE;
+
+    return tierUp_->Execute(targetPC) ? NATIVE_EXITED : NATIVE_RETURNED;
+}
+
+// Operands of raw bytecode engines are read from bytecode_ on every execution
+#define REG_1  registers_[(unsigned char)bytecode_[PC + 1]]
+#define REG_2  registers_[(unsigned char)bytecode_[PC + 2]]
+#define IMM_1  GetImmediate(bytecode_ + PC, kArgType)
+#define IMM_2  GetImmediate(bytecode_ + PC, kArgType)
+#define NEXT() PC += kSizeInstr
+#define RET()  PC = callerStack_.top(); callerStack_.pop()
+
+// Tiered engines leave for native code at hot loop headers: native function
+// runs the rest of the loop and returns from guest function instead of it
+#define JUMP()                                                              \
+    do {                                                                    \
+        int offset = GetLabelOffset(bytecode_ + PC, kArgType);              \
+        int native = (isTiered && offset <= 0) ? EnterNative(PC + offset)   \
+                                               : NATIVE_NONE;               \
+        if (native == NATIVE_EXITED)                                        \
+            return;                                                         \
+        if (native == NATIVE_RETURNED) {                                    \
+            RET();                                                          \
+        }                                                                   \
+        else                                                                \
+            PC += offset;                                                   \
+    } while (0)
+
+#define CALL()                                                              \
+    do {                                                                    \
+        size_t target = PC + GetLabelOffset(bytecode_ + PC, kArgType);     \
+        int native = isTiered ? EnterNative(target) : NATIVE_NONE;          \
+        if (native == NATIVE_EXITED)                                        \
+            return;                                                         \
+        if (native == NATIVE_RETURNED) {                                    \
+            NEXT();                                                         \
+        }                                                                   \
+        else {                                                              \
+            callerStack_.push(PC + kSizeInstr);                             \
+            PC = target;                                                    \
+        }                                                                   \
+    } while (0)
+
+// Profiled engines count every instruction at its PC, Runtime reads only
+// counters of the first instructions of basic blocks
+template <bool isTiered, bool isProfiled>
+void CpuSimulator::RunSwitch()
+{
     #define INSTRUCTION(name, id, argType, num, size, code)  \
-        case id: /*Dump();*/ code break;                     \
+        case id: {                                           \
+            [[maybe_unused]] const size_t kSizeInstr = size; \
+            [[maybe_unused]] const int kArgType = argType;   \
+            if (isProfiled)                                  \
+                profile_[PC]++;                              \
+            /*Dump();*/ code                                 \
+        } break;                                             \
 
 
     #define INSTRUCTIONS
@@ -25,6 +254,293 @@ void CpuSimulator::Run(char* const pathToInputFile)
     #undef INSTRUCTION
 }
 
+// Direct-threaded code: every handler jumps straight to the next one through
+// a table of label addresses, so each guest instruction gets its own
+// indirect branch instead of sharing the one of the switch
+template <bool isTiered, bool isProfiled>
+void CpuSimulator::RunThreaded()
+{
+#if defined(__GNUC__)
+    void* dispatchTable[UCHAR_MAX + 1];
+    for (auto& handler : dispatchTable)
+        handler = &&UNIDENTIFIED;
+
+    #define INSTRUCTION(name, id, argType, num, size, code)  \
+        dispatchTable[id] = &&HANDLER_##name;                \
+
+    #define INSTRUCTIONS
+    #include "Commands_DSL.txt"
+    #undef INSTRUCTION
+
+    #define DISPATCH() goto *dispatchTable[(unsigned char)bytecode_[PC]]
+
+    #define INSTRUCTION(name, id, argType, num, size, code)  \
+        HANDLER_##name: {                                    \
+            [[maybe_unused]] const size_t kSizeInstr = size; \
+            [[maybe_unused]] const int kArgType = argType;   \
+            if (isProfiled)                                  \
+                profile_[PC]++;                              \
+            code                                             \
+        } DISPATCH();                                        \
+
+    DISPATCH();
+    #include "Commands_DSL.txt"
+
+UNIDENTIFIED:
+    throw std::runtime_error
+        ("Simulator: Unidentified instruction " + std::to_string(bytecode_[PC]));
+
+    #undef DISPATCH
+    #undef INSTRUCTIONS
+    #undef INSTRUCTION
+#else
+    RunSwitch<isTiered, isProfiled>();
+#endif
+}
+
+#undef REG_1
+#undef REG_2
+#undef IMM_1
+#undef IMM_2
+#undef NEXT
+#undef JUMP
+#undef CALL
+#undef RET
+
+// Decodes bytecode_ once into microOps_: operands are resolved to register
+// indices, sign-extended numbers and indices of micro-ops of jump targets.
+// Compare with conditional jump becomes superinstruction of Fusion.h, parts
+// of it stay in microOps_ but are never dispatched.
+// The last micro-op traps execution which leaves instruction boundaries.
+void CpuSimulator::Predecode(void* const* dispatchTable,
+                             void* const (*fusedTable)[N_CONDITIONS],
+                             void* trapHandler)
+{
+    std::vector<uint32_t> opIndices(sizeByteCode_ + 1, UINT32_MAX);
+    // Jump and call targets, control may enter superinstruction only there
+    std::vector<bool> isLeader(sizeByteCode_ + 1, false);
+
+    uint32_t nOps = 0;
+    for (size_t PC = 0; PC < sizeByteCode_;) {
+        opIndices[PC] = nOps++;
+
+        int idInstr = (unsigned char)bytecode_[PC];
+        size_t sizeInstr = GetSizeInstr(idInstr);
+        if (sizeInstr == 0)
+            break;
+
+        int argType = GetArgtypeInstr(idInstr);
+        if ((argType == LABEL || argType == WIDE_LABEL) &&
+            PC + sizeInstr <= sizeByteCode_) {
+            size_t targetPC = PC + GetLabelOffset(bytecode_ + PC, argType);
+            if (targetPC < sizeByteCode_)
+                isLeader[targetPC] = true;
+        }
+        PC += sizeInstr;
+    }
+    const uint32_t trapIndex = nOps;
+
+    microOps_.assign(nOps + 1, MicroOp{});
+    microOps_[trapIndex].handler = trapHandler;
+
+    for (size_t PC = 0; PC < sizeByteCode_;) {
+        int idInstr = (unsigned char)bytecode_[PC];
+        size_t sizeInstr = GetSizeInstr(idInstr);
+        if (PC + sizeInstr > sizeByteCode_)
+            throw std::runtime_error("Simulator: Truncated instruction at PC " +
+                                     std::to_string(PC));
+
+        MicroOp& op = microOps_[opIndices[PC]];
+        op.handler = dispatchTable[idInstr];
+        DecodeOperands(PC, op, opIndices, trapIndex);
+
+        FusedInstr fused = MatchFusion(bytecode_, sizeByteCode_, PC,
+                                       isLeader);
+        if (fused.fusion != FUSION_NONE) {
+            MicroOp jump{};
+            DecodeOperands(fused.jumpPC, jump, opIndices, trapIndex);
+
+            if (fused.cmpPC != PC) {
+                op.reg3 = op.reg1;
+                DecodeOperands(fused.cmpPC, op, opIndices, trapIndex);
+            }
+            op.target = jump.target;
+            op.handler = fusedTable[fused.fusion][fused.condition];
+        }
+
+        PC += (sizeInstr != 0) ? sizeInstr : sizeByteCode_;
+    }
+}
+
+void CpuSimulator::DecodeOperands(size_t PC, MicroOp& op,
+                                  const std::vector<uint32_t>& opIndices,
+                                  uint32_t trapIndex) const
+{
+    int argType = GetArgtypeInstr((unsigned char)bytecode_[PC]);
+    switch (argType) {
+    case LABEL:
+    case WIDE_LABEL: {
+        size_t targetPC = PC + GetLabelOffset(bytecode_ + PC, argType);
+        op.target = (targetPC < sizeByteCode_) ? opIndices[targetPC]
+                                               : UINT32_MAX;
+        if (op.target == UINT32_MAX)
+            op.target = trapIndex;
+        break;
+    }
+
+    case NUMBER:
+    case WIDE_NUMBER:
+        op.imm = GetImmediate(bytecode_ + PC, argType);
+        break;
+
+    case REG_NUMBER:
+    case REG_WIDE_NUMBER:
+        op.imm = GetImmediate(bytecode_ + PC, argType);
+        [[fallthrough]];
+    case REG:
+        op.reg1 = bytecode_[PC + 1];
+        break;
+
+    case REG_REG:
+        op.reg1 = bytecode_[PC + 1];
+        op.reg2 = bytecode_[PC + 2];
+        break;
+    }
+
+    if (op.reg1 >= N_REGS || op.reg2 >= N_REGS)
+        throw std::runtime_error("Simulator: Undefined register at PC " +
+                                 std::to_string(PC));
+}
+
+void CpuSimulator::RunPredecoded()
+{
+#if defined(__GNUC__)
+    void* dispatchTable[UCHAR_MAX + 1];
+    for (auto& handler : dispatchTable)
+        handler = &&UNIDENTIFIED;
+
+    #define INSTRUCTION(name, id, argType, num, size, code)  \
+        dispatchTable[id] = &&HANDLER_##name;                \
+
+    #define INSTRUCTIONS
+    #include "Commands_DSL.txt"
+    #undef INSTRUCTION
+
+    // Superinstructions of Fusion.h: one handler for every compare and
+    // condition of jump, REG_3 is loop counter of inc/dec before compare
+    #define FUSED_INSTRUCTIONS                                              \
+        FUSION(CMP,       2, isFlag = GetCompareFlag(REG_1, IMM_2);)        \
+        FUSION(CMP_R,     2, isFlag = GetCompareFlag(REG_1, REG_2);)        \
+        FUSION(CMP_RP,    2,                                                \
+               isFlag = GetCompareFlag(REG_1, Memory(REG_2));)              \
+        FUSION(CMP_PP,    2,                                                \
+               isFlag = GetCompareFlag(Memory(REG_1), Memory(REG_2));)      \
+        FUSION(INC_CMP,   3, REG_3++;                                       \
+               isFlag = GetCompareFlag(REG_1, IMM_2);)                      \
+        FUSION(INC_CMP_R, 3, REG_3++;                                       \
+               isFlag = GetCompareFlag(REG_1, REG_2);)                      \
+        FUSION(DEC_CMP,   3, REG_3--;                                       \
+               isFlag = GetCompareFlag(REG_1, IMM_2);)                      \
+        FUSION(DEC_CMP_R, 3, REG_3--;                                       \
+               isFlag = GetCompareFlag(REG_1, REG_2);)                      \
+
+    void* fusedTable[N_FUSIONS][N_CONDITIONS] = {};
+
+    #define FUSED_HANDLER(fusion, condition, relation, nInstrs, code)      \
+        fusedTable[FUSION_##fusion][CONDITION_##condition] =               \
+            &&HANDLER_##fusion##_##condition;                              \
+
+    #define FUSION(fusion, nInstrs, code)                                  \
+        FUSED_HANDLER(fusion, G,  >,  nInstrs, code)                       \
+        FUSED_HANDLER(fusion, GE, >=, nInstrs, code)                       \
+        FUSED_HANDLER(fusion, L,  <,  nInstrs, code)                       \
+        FUSED_HANDLER(fusion, LE, <=, nInstrs, code)                       \
+        FUSED_HANDLER(fusion, E,  ==, nInstrs, code)                       \
+        FUSED_HANDLER(fusion, NE, !=, nInstrs, code)                       \
+
+    FUSED_INSTRUCTIONS
+    #undef FUSED_HANDLER
+
+    Predecode(dispatchTable, fusedTable, &&TRAP);
+
+    const MicroOp* const ops = microOps_.data();
+    const MicroOp* op = ops;
+
+    #define REG_1  registers_[op->reg1]
+    #define REG_2  registers_[op->reg2]
+    #define IMM_1  op->imm
+    #define IMM_2  op->imm
+    #define NEXT() ++op
+    #define JUMP() op = ops + op->target
+    #define CALL() callerStack_.push(op + 1 - ops); JUMP()
+    #define RET()  op = ops + callerStack_.top(); callerStack_.pop()
+
+    #define DISPATCH() goto *op->handler
+
+    #define INSTRUCTION(name, id, argType, num, size, code)  \
+        HANDLER_##name: { code } DISPATCH();                 \
+
+    DISPATCH();
+    #include "Commands_DSL.txt"
+
+    #define REG_3  registers_[op->reg3]
+
+    #define FUSED_HANDLER(fusion, condition, relation, nInstrs, code)      \
+        HANDLER_##fusion##_##condition: {                                  \
+            code                                                           \
+            if (isFlag relation 0)                                         \
+                JUMP();                                                    \
+            else                                                           \
+                op += nInstrs;                                             \
+        } DISPATCH();                                                      \
+
+    FUSED_INSTRUCTIONS
+
+UNIDENTIFIED:
+    throw std::runtime_error
+        ("Simulator: Unidentified instruction in micro-op " +
+         std::to_string(op - ops));
+
+TRAP:
+    throw std::runtime_error("Simulator: Execution left instruction boundaries");
+
+    #undef FUSED_INSTRUCTIONS
+    #undef FUSED_HANDLER
+    #undef FUSION
+    #undef DISPATCH
+    #undef REG_1
+    #undef REG_2
+    #undef REG_3
+    #undef IMM_1
+    #undef IMM_2
+    #undef NEXT
+    #undef JUMP
+    #undef CALL
+    #undef RET
+    #undef INSTRUCTIONS
+    #undef INSTRUCTION
+#else
+    RunSwitch<false, false>();
+#endif
+}
+
+// The same input as Translator::Impl::PreTranslateBenchmark() creates:
+// reversed array and its bounds on the stack
+void CpuSimulator::PrepareBenchmark()
+{
+    if (!isAnalyse_)
+        return;
+
+    if (memory_.size() <= sizeBenchmark_)
+        throw std::runtime_error("Simulator: Memory is too small for benchmark");
+
+    for (size_t i = 0; i < sizeBenchmark_; i++)
+        memory_[i] = memory_.size() - i;
+
+    stack_.push(0);
+    stack_.push(sizeBenchmark_);
+}
+
 void CpuSimulator::ReadBytecode (char* const pathToInputFile)
 {
     FILE* inputFile = fopen(pathToInputFile, "rb");
@@ -33,18 +549,19 @@ void CpuSimulator::ReadBytecode (char* const pathToInputFile)
         throw std::runtime_error("Simulator: Can`t open input file");
 
     fseek(inputFile, 0, SEEK_END);
-    size_t fileSize = ftell(inputFile);
+    sizeByteCode_ = ftell(inputFile);
     fseek(inputFile, 0, SEEK_SET);
 
-    AllocByteCodeBuf(fileSize);
+    AllocByteCodeBuf(sizeByteCode_);
 
-    fread(bytecode_, 1, fileSize, inputFile);
+    fread(bytecode_, 1, sizeByteCode_, inputFile);
 
     fclose(inputFile);
 }
 
 void CpuSimulator::AllocByteCodeBuf(size_t size)
 {
+    delete[] bytecode_;
     bytecode_ = new char[size];
 }
 
@@ -1,31 +1,139 @@
 #ifndef BINARY_TRANSLATOR_SIMULATOR_SIMULATOR_H
 #define BINARY_TRANSLATOR_SIMULATOR_SIMULATOR_H
 
+#include "Bytecode.h"
 #include "Constants.h"
+#include "FixedStack.h"
+#include "Fusion.h"
+#include "TierUp.h"
 
-#include <stack>
+#include <cstdint>
+#include <vector>
 
 #include <iostream>
 
 namespace BinaryTranslator {
 
+const size_t DEFAULT_SIZE_STACK = SIZE_STACK;
+const uint32_t DEFAULT_TIER_UP_THRESHOLD = 1000;
+
+enum Dispatches {
+    DISPATCH_SWITCH,
+    DISPATCH_THREADED,
+    DISPATCH_PREDECODED,
+};
+
+struct SimulatorConfig {
+    int dispatch = DISPATCH_SWITCH;
+    size_t sizeStack = DEFAULT_SIZE_STACK;
+    size_t sizeMemory = SIZE_MEMORY;
+    // Fill memory and stack with input of benchmark programs: reversed array
+    // of sizeBenchmark words, it has to be shorter than memory
+    bool isAnalyse = false;
+    size_t sizeBenchmark = SIZE_MEMORY_BENCHMARK;
+    // Print profile of guest program on its exit, see RuntimeReportProfile().
+    // Native code of tiered execution is not counted, so it is not profiled.
+    bool isProfile = false;
+    // Native tier, nullptr - only interpret. Call target or loop header is
+    // compiled after tierUpThreshold executions.
+    TierUp* tierUp = nullptr;
+    uint32_t tierUpThreshold = DEFAULT_TIER_UP_THRESHOLD;
+};
+
 class CpuSimulator {
 private:
     int registers_[N_REGS] = {0};
-    std::stack<int> stack_;
-    std::stack<int> callerStack_;
+    FixedStack<int> stack_;
+    FixedStack<size_t> callerStack_;
     int isFlag = 0;
 
+    // Guest addresses are indices of words in memory_, not host pointers
+    std::vector<int> memory_;
+
     size_t PC = 0;
 
     char* bytecode_ = nullptr;
+    size_t sizeByteCode_ = 0;
+
+    int dispatch_ = DISPATCH_SWITCH;
+    bool isAnalyse_ = false;
+    size_t sizeBenchmark_ = SIZE_MEMORY_BENCHMARK;
+    bool isProfile_ = false;
+    // Executions of instruction at each PC
+    std::vector<uint64_t> profile_;
+
+    struct MicroOp {
+        void* handler = nullptr;
+        int imm = 0;
+        uint32_t target = 0;
+        unsigned char reg1 = 0;
+        unsigned char reg2 = 0;
+        // Loop counter of superinstruction which starts with inc/dec
+        unsigned char reg3 = 0;
+    };
+
+    std::vector<MicroOp> microOps_;
+
+    enum Tiers : unsigned char {
+        TIER_INTERPRETED,
+        TIER_NATIVE,
+        TIER_NO_NATIVE,
+    };
+
+    enum NativeResults {
+        NATIVE_NONE,
+        NATIVE_RETURNED,
+        NATIVE_EXITED,
+    };
+
+    TierUp* tierUp_ = nullptr;
+    uint32_t tierUpThreshold_ = DEFAULT_TIER_UP_THRESHOLD;
+    // Executions and tier of call target or loop header at each PC
+    std::vector<uint32_t> hotness_;
+    std::vector<unsigned char> tiers_;
 
     void ReadBytecode (char* const pathToInputFile);
 
     void AllocByteCodeBuf(size_t size);
 
+    void CheckRegisters() const;
+    void ResetState();
+    void PrepareBenchmark();
+    void Execute();
+
+    int& Memory(int address)
+    {
+        if (static_cast<unsigned>(address) >= memory_.size())
+            throw std::runtime_error("Simulator: Invalid memory address " +
+                                     std::to_string(address));
+        return memory_[address];
+    }
+
+    void AttachTierUp();
+    int EnterNative(size_t targetPC);
+
+    template <bool isTiered, bool isProfiled> void RunSwitch();
+    template <bool isTiered, bool isProfiled> void RunThreaded();
+
+    void Predecode(void* const* dispatchTable,
+                   void* const (*fusedTable)[N_CONDITIONS], void* trapHandler);
+    void DecodeOperands(size_t PC, MicroOp& op,
+                        const std::vector<uint32_t>& opIndices,
+                        uint32_t trapIndex) const;
+    void RunPredecoded();
+
 public:
-    CpuSimulator() = default;
+    explicit CpuSimulator(const SimulatorConfig& config = {}) :
+        stack_(config.sizeStack),
+        callerStack_(config.sizeStack),
+        memory_(config.sizeMemory, 0),
+        dispatch_(config.dispatch),
+        isAnalyse_(config.isAnalyse),
+        sizeBenchmark_(config.sizeBenchmark),
+        isProfile_(config.isProfile),
+        tierUp_(config.tierUp),
+        tierUpThreshold_(config.tierUpThreshold)
+        {}
 
     ~CpuSimulator()
     {
@@ -33,6 +141,8 @@ public:
     }
 
     void Run(char *const pathToInputFile);
+    // Bytecode is copied, so it does not have to outlive simulation
+    void Run(ByteSpan bytecode);
 
     void Dump() const;
 }; //class CpuSimulator
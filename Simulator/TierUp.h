@@ -0,0 +1,31 @@
+#ifndef BINARY_TRANSLATOR_SIMULATOR_TIERUP_H
+#define BINARY_TRANSLATOR_SIMULATOR_TIERUP_H
+
+#include "Bytecode.h"
+#include "GuestState.h"
+
+#include <cstddef>
+
+namespace BinaryTranslator {
+
+// Native tier of CPU-Simulator. Simulator counts executions of call targets
+// and loop headers and offers hot ones to compile; compiled code runs on
+// guest state of simulator and returns control when its function returns.
+class TierUp {
+public:
+    virtual ~TierUp() = default;
+
+    // Simulator starts to run bytecode on guestState
+    virtual void Attach(ByteSpan bytecode, const GuestState& guestState) = 0;
+
+    // Compiles guest code to be entered at PC, returns false if it can`t
+    virtual bool Compile(size_t PC) = 0;
+
+    // Runs compiled code from PC until its guest function returns, returns
+    // true if guest program exited instead
+    virtual bool Execute(size_t PC) = 0;
+}; // class TierUp
+
+} //namespace BinaryTranslator
+
+#endif // BINARY_TRANSLATOR_SIMULATOR_TIERUP_H
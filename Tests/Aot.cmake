@@ -0,0 +1,28 @@
+# Compiles PROGRAM with TRANSLATOR ahead of time into OUTPUT.o and OUTPUT
+# executable: object is ELF of host and executable prints EXPECTED
+execute_process(COMMAND ${TRANSLATOR} ${PROGRAM} ${OUTPUT}.bin
+                        --emit-obj=${OUTPUT}.o ${OPTIONS}
+                RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "Can`t emit object of ${PROGRAM}: ${result}")
+endif()
+
+file(READ ${OUTPUT}.o magic LIMIT 4 HEX)
+if(NOT magic STREQUAL "7f454c46")
+    message(FATAL_ERROR "${OUTPUT}.o is not ELF object: ${magic}")
+endif()
+
+file(REMOVE ${OUTPUT})
+execute_process(COMMAND ${TRANSLATOR} ${PROGRAM} ${OUTPUT}.bin
+                        --emit-exe=${OUTPUT} ${OPTIONS}
+                RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "Can`t emit executable of ${PROGRAM}: ${result}")
+endif()
+
+execute_process(COMMAND ${OUTPUT} RESULT_VARIABLE result
+                OUTPUT_VARIABLE output)
+if(NOT result EQUAL 0 OR NOT output STREQUAL EXPECTED)
+    message(FATAL_ERROR "Executable of ${PROGRAM} failed with ${result}: "
+                        "${output}")
+endif()
@@ -0,0 +1,13 @@
+# Assembles PROGRAM into OUTPUT with TRANSLATOR and checks that bytecode
+# takes SIZE bytes: encoding of jumps and numbers is the shortest one
+execute_process(COMMAND ${TRANSLATOR} ${PROGRAM} ${OUTPUT} --sim
+                RESULT_VARIABLE result OUTPUT_QUIET)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "Can`t assemble ${PROGRAM}: ${result}")
+endif()
+
+file(SIZE ${OUTPUT} size)
+if(NOT size EQUAL SIZE)
+    message(FATAL_ERROR "Bytecode of ${PROGRAM} takes ${size} bytes "
+                        "instead of ${SIZE}")
+endif()
@@ -0,0 +1,46 @@
+# Runs PROGRAM and OTHER_PROGRAM with TRANSLATOR in --jit --cache-dir=CACHE:
+# the first run stores object, the next ones load it, other options and
+# other bytecode get objects of their own
+function(run_cached program expected)
+    execute_process(COMMAND ${TRANSLATOR} ${program} ${CACHE}.bin
+                            --jit --cache-dir=${CACHE} ${ARGN}
+                    RESULT_VARIABLE result OUTPUT_VARIABLE output
+                    ERROR_QUIET)
+    if(NOT result EQUAL 0 OR NOT output STREQUAL expected)
+        message(FATAL_ERROR "Run of ${program} ${ARGN} failed with ${result}:"
+                            " ${output}")
+    endif()
+endfunction()
+
+function(check_objects number)
+    file(GLOB objects ${CACHE}/*.o)
+    list(LENGTH objects length)
+    if(NOT length EQUAL number)
+        message(FATAL_ERROR "Cache has ${length} objects instead of ${number}")
+    endif()
+endfunction()
+
+file(REMOVE_RECURSE ${CACHE})
+
+run_cached(${PROGRAM} "3\n")
+check_objects(1)
+run_cached(${PROGRAM} "3\n")
+check_objects(1)
+
+# Object is loaded instead of translating the program again: broken object
+# breaks the run
+file(GLOB object ${CACHE}/*.o)
+file(WRITE ${object} "broken")
+execute_process(COMMAND ${TRANSLATOR} ${PROGRAM} ${CACHE}.bin
+                        --jit --cache-dir=${CACHE}
+                RESULT_VARIABLE result OUTPUT_QUIET ERROR_QUIET)
+if(result EQUAL 0)
+    message(FATAL_ERROR "Cached object is not used")
+endif()
+
+run_cached(${PROGRAM} "3\n" -O2)
+check_objects(2)
+run_cached(${PROGRAM} "3\n" --stack-size=100)
+check_objects(3)
+run_cached(${OTHER_PROGRAM} "1\n")
+check_objects(4)
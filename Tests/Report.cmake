@@ -0,0 +1,54 @@
+# Runs PROGRAM with TRANSLATOR and appends records of the runs to
+# OUTPUT.json and OUTPUT.csv: every record names its engine and counts
+# executed instructions, tiered runs can`t count them
+function(run_reported report)
+    execute_process(COMMAND ${TRANSLATOR} ${PROGRAM} ${OUTPUT}.bin
+                            --report=${report} ${ARGN}
+                    RESULT_VARIABLE result OUTPUT_VARIABLE output
+                    ERROR_QUIET)
+    # Profile is printed only if it is asked for
+    if(NOT result EQUAL 0 OR NOT output STREQUAL "3\n")
+        message(FATAL_ERROR "Run of ${PROGRAM} ${ARGN} failed with ${result}:"
+                            " ${output}")
+    endif()
+endfunction()
+
+function(check_line report number regex)
+    file(STRINGS ${report} lines)
+    list(LENGTH lines length)
+    if(NOT length GREATER number)
+        message(FATAL_ERROR "${report} has ${length} lines only")
+    endif()
+    list(GET lines ${number} line)
+    if(NOT line MATCHES "${regex}")
+        message(FATAL_ERROR "Line ${number} of ${report} is wrong: ${line}")
+    endif()
+endfunction()
+
+file(REMOVE ${OUTPUT}.json ${OUTPUT}.csv)
+
+run_reported(${OUTPUT}.json --jit)
+run_reported(${OUTPUT}.json --sim --dispatch=predecoded)
+run_reported(${OUTPUT}.json --tiered)
+
+string(CONCAT counted
+       "\"profiled\": true, \"timeMs\": [0-9.]+, \"instructions\": 12, "
+       "\"instructionsPerSecond\": [0-9]+, \"opcodes\": {\"push\": 0, .*"
+       "\"inc\": 3, .*\"cmp\": 2, .*\"jmp\": 2, .*\"jl\": 2, .*}}$")
+check_line(${OUTPUT}.json 0 "^{\"program\": \"[^\"]*forward_labels.txt\", \"engine\": \"--jit\", ${counted}")
+# Profiled simulator interprets predecoded code as threaded
+check_line(${OUTPUT}.json 1 "\"engine\": \"--sim --dispatch=threaded\", ${counted}")
+check_line(${OUTPUT}.json 2 "\"engine\": \"--tiered\", \"profiled\": false, \"timeMs\": [0-9.]+, \"instructions\": null, \"instructionsPerSecond\": null, \"opcodes\": null}$")
+
+run_reported(${OUTPUT}.csv --report-format=csv --sim)
+run_reported(${OUTPUT}.csv --report-format=csv --tiered)
+
+# Header is written once, to the empty report
+check_line(${OUTPUT}.csv 0 "^program,engine,profiled,time_ms,instructions,instructions_per_second,push,push_r,pop_r,mov,")
+check_line(${OUTPUT}.csv 1 "^\"[^\"]*forward_labels.txt\",\"--sim\",true,[0-9.]+,12,[0-9]+,0,0,0,1,0,0,0,0,0,1,1,")
+check_line(${OUTPUT}.csv 2 "^\"[^\"]*forward_labels.txt\",\"--tiered\",false,[0-9.]+,,,*$")
+file(STRINGS ${OUTPUT}.csv lines)
+list(LENGTH lines length)
+if(NOT length EQUAL 3)
+    message(FATAL_ERROR "${OUTPUT}.csv has ${length} lines instead of 3")
+endif()
@@ -0,0 +1,45 @@
+#include "TieredExecutor.h"
+
+#include <iostream>
+
+using namespace BinaryTranslator;
+
+void TieredExecutor::Attach(ByteSpan bytecode, const GuestState& guestState)
+{
+    bytecode_ = bytecode;
+    guestState_ = guestState;
+
+    translator_.reset();
+    isCompiled_ = false;
+    isFailed_ = false;
+}
+
+void TieredExecutor::CompileProgram()
+{
+    try {
+        translator_ = std::make_unique<Translator>(bytecode_, guestState_);
+        translator_->Translate();
+        translator_->Optimize(optLevel_);
+        translator_->Compile();
+        isCompiled_ = true;
+    }
+    catch (std::exception& exception) {
+        std::cerr << "[Tiered] Staying in simulator: " << exception.what()
+                  << "\n";
+        translator_.reset();
+        isFailed_ = true;
+    }
+}
+
+bool TieredExecutor::Compile(size_t PC)
+{
+    if (!isCompiled_ && !isFailed_)
+        CompileProgram();
+
+    return isCompiled_ && translator_->HasNativeEntry(PC);
+}
+
+bool TieredExecutor::Execute(size_t PC)
+{
+    return translator_->RunFrom(PC);
+}
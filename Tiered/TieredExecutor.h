@@ -0,0 +1,39 @@
+#ifndef BINARY_TRANSLATOR_TIERED_TIEREDEXECUTOR_H
+#define BINARY_TRANSLATOR_TIERED_TIEREDEXECUTOR_H
+
+#include "TierUp.h"
+#include "Translator.h"
+
+#include <memory>
+
+namespace BinaryTranslator {
+
+// Native tier of CPU-Simulator built on Translator: the first hot region
+// translates and JIT-compiles the whole program once, later ones reuse it.
+// Program which Translator can`t handle stays in the interpreter.
+class TieredExecutor : public TierUp {
+private:
+    unsigned optLevel_ = 0;
+
+    ByteSpan bytecode_{};
+    GuestState guestState_{};
+
+    std::unique_ptr<Translator> translator_;
+    bool isCompiled_ = false;
+    bool isFailed_ = false;
+
+    void CompileProgram();
+
+public:
+    explicit TieredExecutor(unsigned optLevel = 0) :
+        optLevel_(optLevel)
+        {}
+
+    void Attach(ByteSpan bytecode, const GuestState& guestState) override;
+    bool Compile(size_t PC) override;
+    bool Execute(size_t PC) override;
+}; // class TieredExecutor
+
+} //namespace BinaryTranslator
+
+#endif // BINARY_TRANSLATOR_TIERED_TIEREDEXECUTOR_H
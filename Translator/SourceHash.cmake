@@ -0,0 +1,12 @@
+# Writes OUTPUT header with SHA1 of SOURCES: native code of translated
+# programs depends on them, so the hash is a part of the cache key
+set(hashes "")
+foreach(source IN LISTS SOURCES)
+    file(SHA1 ${source} hash)
+    string(APPEND hashes "${hash}\n")
+endforeach()
+
+string(SHA1 hash "${hashes}")
+file(WRITE ${OUTPUT}
+     "// Generated by SourceHash.cmake from sources of translation\n"
+     "#define TRANSLATION_SOURCE_HASH \"${hash}\"\n")
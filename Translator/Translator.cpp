@@ -1,17 +1,49 @@
 
 #include "Translator.h"
 
+#include "Bytecode.h"
 #include "Constants.h"
-
+#include "Fusion.h"
+#include "Runtime.h"
+#include "SourceHash.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/ExecutionEngine/Orc/IndirectionUtils.h"
+#include "llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/LazyReexports.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/IR/Value.h"
-
+#include "llvm/IR/Verifier.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/SHA1.h"
+#include "llvm/Support/SmallVectorMemoryBuffer.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/SplitModule.h"
+
+#include <algorithm>
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <random>
-#include <stack>
+#include <unordered_map>
 
 using namespace BinaryTranslator;
 
@@ -20,17 +52,25 @@ namespace {
 const int MAX_RANDOM = 100;
 const int MIN_RANDOM = 0;
 
-int GetNumberIdInstr(int idInstr)
+// More parts of module than threads balance functions of different size
+const unsigned PARTS_PER_THREAD = 4;
+
+// Version of layout of cache directory: names and contents of its files.
+// Changes of translation are tracked by TRANSLATION_SOURCE_HASH.
+const unsigned CACHE_FORMAT_VERSION = 1;
+
+int GetArgtypeInstr(int idInstr)
 {
     #define INSTRUCTION(name, id, argType, num, size, code)  \
-        case id: return num;                                 \
+        case id: return argType;                             \
 
     #define INSTRUCTIONS
     switch (idInstr) {
     #include "Commands_DSL.txt"
 
+    case N_INST: return N_INST;
     default:
-        throw std::runtime_error("GetNumberIdInstr():"
+        throw std::runtime_error("GetArgtypeInstr():"
                                  "Unidefined instruction " +
                                  std::to_string(idInstr));
     }
@@ -39,18 +79,17 @@ int GetNumberIdInstr(int idInstr)
     #undef INSTRUCTION
 }
 
-int GetArgtypeInstr(int idInstr)
+size_t GetSizeInstr(int idInstr)
 {
     #define INSTRUCTION(name, id, argType, num, size, code)  \
-        case id: return argType;                             \
+        case id: return size;                                \
 
     #define INSTRUCTIONS
     switch (idInstr) {
     #include "Commands_DSL.txt"
 
-    case N_INST: return N_INST;
     default:
-        throw std::runtime_error("GetArgtypeInstr():"
+        throw std::runtime_error("GetSizeInstr():"
                                  "Unidefined instruction " +
                                  std::to_string(idInstr));
     }
@@ -66,13 +105,43 @@ bool IsRegRegInst(int inst)
     return false;
 }
 
+bool IsCallInstr(int inst)
+{
+    return inst == CALL || inst == CALL_W;
+}
+
 bool IsJumpInstr(int inst)
 {
-    if (GetArgtypeInstr(inst) == LABEL)
+    int argType = GetArgtypeInstr(inst);
+    if ((argType == LABEL || argType == WIDE_LABEL) && !IsCallInstr(inst))
         return true;
     return false;
 }
 
+// Instructions after which control never falls through to the next one
+bool IsTerminatorInstr(int inst)
+{
+    return inst == JMP || inst == JMP_W || inst == RET || inst == EXIT;
+}
+
+// Signed test of flag against zero which conditional jump makes
+llvm::CmpInst::Predicate GetPredicate(int condition)
+{
+    switch (condition) {
+    case CONDITION_G:  return llvm::CmpInst::Predicate::ICMP_SGT;
+    case CONDITION_GE: return llvm::CmpInst::Predicate::ICMP_SGE;
+    case CONDITION_L:  return llvm::CmpInst::Predicate::ICMP_SLT;
+    case CONDITION_LE: return llvm::CmpInst::Predicate::ICMP_SLE;
+    case CONDITION_E:  return llvm::CmpInst::Predicate::ICMP_EQ;
+    case CONDITION_NE: return llvm::CmpInst::Predicate::ICMP_NE;
+
+    default:
+        throw std::runtime_error("GetPredicate():"
+                                 "Undefined condition " +
+                                 std::to_string(condition));
+    }
+}
+
 int GetRandomNumber(int min, int max)
 {
     std::uniform_int_distribution<> UID{min, max};
@@ -81,14 +150,161 @@ int GetRandomNumber(int min, int max)
     return UID(RE);
 }
 
+void CheckError(llvm::Error error)
+{
+    if (error)
+        throw std::runtime_error("Translator: " +
+                                 llvm::toString(std::move(error)));
+}
+
+template <typename T>
+T CheckError(llvm::Expected<T> expected)
+{
+    if (!expected)
+        CheckError(expected.takeError());
+
+    return std::forward<T>(*expected);
+}
+
+// Target machines are created on threads of parallel compilation too, but
+// target registry has to be filled only once
+void InitializeNativeTarget()
+{
+    static std::once_flag isInitialized;
+    std::call_once(isInitialized, []{
+        llvm::InitializeNativeTarget();
+        llvm::InitializeNativeTargetAsmPrinter();
+    });
+}
+
+std::unique_ptr<llvm::TargetMachine> CreateHostTargetMachine()
+{
+    InitializeNativeTarget();
+
+    llvm::orc::JITTargetMachineBuilder targetMachineBuilder =
+        CheckError(llvm::orc::JITTargetMachineBuilder::detectHost());
+    // Objects are linked into position independent executables
+    targetMachineBuilder.setRelocationModel(llvm::Reloc::PIC_);
+
+    return CheckError(targetMachineBuilder.createTargetMachine());
+}
+
+// JIT which resolves guest I/O with Runtime linked into this process
+std::unique_ptr<llvm::orc::LLJIT> CreateJIT()
+{
+    InitializeNativeTarget();
+
+    std::unique_ptr<llvm::orc::LLJIT> jit =
+        CheckError(llvm::orc::LLJITBuilder().create());
+
+    // Library calls which LLVM may emit are taken from the host libc
+    jit->getMainJITDylib().addGenerator(CheckError(
+        llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+            jit->getDataLayout().getGlobalPrefix())));
+
+    llvm::orc::MangleAndInterner mangle(jit->getExecutionSession(),
+                                        jit->getDataLayout());
+    CheckError(jit->getMainJITDylib().define(llvm::orc::absoluteSymbols({
+        {mangle("RuntimeWrite"),
+         llvm::JITEvaluatedSymbol::fromPointer(&RuntimeWrite)},
+        {mangle("RuntimeRead"),
+         llvm::JITEvaluatedSymbol::fromPointer(&RuntimeRead)},
+        {mangle("RuntimeFlush"),
+         llvm::JITEvaluatedSymbol::fromPointer(&RuntimeFlush)},
+        {mangle("RuntimeStackOverflow"),
+         llvm::JITEvaluatedSymbol::fromPointer(&RuntimeStackOverflow)},
+        {mangle("RuntimeStackUnderflow"),
+         llvm::JITEvaluatedSymbol::fromPointer(&RuntimeStackUnderflow)},
+        {mangle("RuntimeInvalidAddress"),
+         llvm::JITEvaluatedSymbol::fromPointer(&RuntimeInvalidAddress)},
+        {mangle("RuntimeStartProfile"),
+         llvm::JITEvaluatedSymbol::fromPointer(&RuntimeStartProfile)},
+        {mangle("RuntimeReportProfile"),
+         llvm::JITEvaluatedSymbol::fromPointer(&RuntimeReportProfile)},
+    })));
+
+    return jit;
+}
+
+// Stub of guest function calls it instead if the function can`t be compiled:
+// exceptions can`t unwind through JIT-ed frames
+void ReportLazyCompileError()
+{
+    std::cerr << "Translator: Can`t compile guest function lazily\n";
+    exit(EXIT_FAILURE);
+}
+
+int RunMain(llvm::orc::LLJIT& jit)
+{
+    llvm::JITEvaluatedSymbol mainSymbol = CheckError(jit.lookup("main"));
+    auto mainFunc = reinterpret_cast<int (*)()>(mainSymbol.getAddress());
+
+    return mainFunc();
+}
+
+llvm::OptimizationLevel GetOptimizationLevel(unsigned optLevel)
+{
+    switch (optLevel) {
+    case 1: return llvm::OptimizationLevel::O1;
+    case 2: return llvm::OptimizationLevel::O2;
+    case 3: return llvm::OptimizationLevel::O3;
+
+    default:
+        throw std::runtime_error("Translator: Unsupported optimization level " +
+                                 std::to_string(optLevel));
+    }
+}
+
+// Runs LLVM O<optLevel> pipeline over module
+void OptimizeModule(llvm::Module& module, unsigned optLevel)
+{
+    // Target info lets loop and SLP vectorizers pick host vector widths
+    std::unique_ptr<llvm::TargetMachine> targetMachine =
+        CreateHostTargetMachine();
+
+    module.setTargetTriple(targetMachine->getTargetTriple().str());
+    module.setDataLayout(targetMachine->createDataLayout());
+
+    llvm::LoopAnalysisManager    loopAM;
+    llvm::FunctionAnalysisManager functionAM;
+    llvm::CGSCCAnalysisManager   cgsccAM;
+    llvm::ModuleAnalysisManager  moduleAM;
+
+    llvm::PassBuilder passBuilder(targetMachine.get());
+    passBuilder.registerModuleAnalyses(moduleAM);
+    passBuilder.registerCGSCCAnalyses(cgsccAM);
+    passBuilder.registerFunctionAnalyses(functionAM);
+    passBuilder.registerLoopAnalyses(loopAM);
+    passBuilder.crossRegisterProxies(loopAM, functionAM, cgsccAM, moduleAM);
+
+    llvm::ModulePassManager modulePM =
+        passBuilder.buildPerModuleDefaultPipeline(
+            GetOptimizationLevel(optLevel));
+    modulePM.run(module, moduleAM);
+}
+
+// Writes native object of module for host, code generation changes IR
+void EmitModuleObject(llvm::Module& module, llvm::raw_pwrite_stream& output)
+{
+    std::unique_ptr<llvm::TargetMachine> targetMachine =
+        CreateHostTargetMachine();
+
+    module.setTargetTriple(targetMachine->getTargetTriple().str());
+    module.setDataLayout(targetMachine->createDataLayout());
+
+    llvm::legacy::PassManager codegenPM;
+    if (targetMachine->addPassesToEmitFile(codegenPM, output, nullptr,
+                                           llvm::CGFT_ObjectFile))
+        throw std::runtime_error("Translator: Target can`t emit object file");
+
+    codegenPM.run(module);
+}
+
 } // anonymous namespace
 
 
 class Translator::Impl {
 private:
-    const size_t SIZE_MEMORY = 1000;
-    const size_t SIZE_MEMORY_BENCHMARK = SIZE_MEMORY;
-
     std::string pathToInputFile_;
 
     unsigned char* bytecode_ = nullptr;
@@ -96,17 +312,18 @@ private:
     size_t PC_ = 0;
     std::string output_;
 
-    llvm::LLVMContext context_;
-    llvm::Module* module_       = nullptr;
+    llvm::orc::ThreadSafeContext threadSafeContext_ {
+        std::make_unique<llvm::LLVMContext>()
+    };
+    llvm::LLVMContext& context_ = *threadSafeContext_.getContext();
+    std::unique_ptr<llvm::Module> module_;
     llvm::Function* curFunc_    = nullptr;
     llvm::IRBuilder<>* builder_ = nullptr;
 
-    std::stack<llvm::Value*> stackIR_;
-    llvm::Value* curCmpValue_   = nullptr;
-
     struct GlobalArray {
         size_t size = 0;
         std::string name{};
+        unsigned bits = 32;
         llvm::ArrayType* type       = nullptr;
         llvm::GlobalVariable* array = nullptr;
     };
@@ -121,17 +338,44 @@ private:
         .name = "memory",
     };
 
-    GlobalArray benchmarkResult_ {
-        .size = N_INST + 1,
-        .name = "nTacts",
+    // Difference of the last compared values, isFlag of CPU-Simulator
+    GlobalArray flag_ {
+        .size = 1,
+        .name = "flag",
+    };
+
+    // Guest value stack and number of words in it
+    GlobalArray stack_ {
+        .size = SIZE_STACK,
+        .name = "stack",
     };
 
-    struct BranchBB {
-        llvm::BasicBlock* trueBB  = nullptr;
-        size_t truePC = 0;
+    GlobalArray stackTop_ {
+        .size = 1,
+        .name = "stackTop",
+        .bits = 64,
+    };
 
-        llvm::BasicBlock* falseBB = nullptr;
-        size_t falsePC = 0;
+    // Depth of guest calls, it is bounded like return stack of CPU-Simulator
+    GlobalArray callDepth_ {
+        .size = 1,
+        .name = "callDepth",
+        .bits = 64,
+    };
+    size_t sizeCallStack_ = SIZE_STACK;
+
+    // Guest program exited inside of guest function: its callers return
+    // at once up to main, which ends the program
+    GlobalArray exited_ {
+        .size = 1,
+        .name = "exited",
+    };
+
+    // Executions of basic block at PC of its first instruction, it is
+    // sized by StartProfile()
+    GlobalArray blockCounts_ {
+        .name = "blockCounts",
+        .bits = 64,
     };
 
     struct TranslatedValue {
@@ -139,42 +383,153 @@ private:
         llvm::Value* val = nullptr;
     };
 
-    std::map <size_t, BranchBB> branchBBs_;
-    std::map <size_t, llvm::Function*> functions_;
+    // Guest registers, stack top and flag of function are kept in its
+    // allocas and are written back to globals only around guest calls, so
+    // LLVM may promote them to SSA
+    struct GuestFrame {
+        llvm::BasicBlock* entryBB = nullptr;
+        llvm::Value* regs[N_REGS] = {};
+        llvm::Value* stackTop = nullptr;
+        // Difference of compared values, jumps outside of superinstructions
+        // test it against zero like isFlag of CPU-Simulator
+        llvm::Value* flag = nullptr;
+        // Shared targets of stack bounds checks, created on demand
+        llvm::BasicBlock* overflowBB = nullptr;
+        llvm::BasicBlock* underflowBB = nullptr;
+        // Exit of guest program, main ends it and functions return to
+        // their callers, created on demand
+        llvm::BasicBlock* exitBB = nullptr;
+        // Shared target of memory bounds checks, it reports address of phi
+        llvm::BasicBlock* invalidAddressBB = nullptr;
+        llvm::PHINode* invalidAddress = nullptr;
+    };
+
+    // Leader index: basic block and function starting at each bytecode PC
+    std::vector<bool> isLeader_;
+    std::vector<bool> isFuncEntry_;
+    std::vector<size_t> funcEntries_;
+    // Blocks of the function being translated, which owns [begin, end)
+    std::vector<llvm::BasicBlock*> blocks_;
+    size_t funcBeginPC_ = 0;
+    size_t funcEndPC_ = 0;
+    std::map <llvm::Function*, GuestFrame> frames_;
+    GuestFrame* curFrame_ = nullptr;
 
     bool isAnalyse_ = false;
+    bool isProfile_ = false;
+    size_t sizeBenchmark_ = SIZE_MEMORY_BENCHMARK;
+
+    // Guest functions are translated on their first call, see RunLazy()
+    bool isLazy_ = false;
+    unsigned optLevel_ = 0;
+
+    class FunctionUnit;
+
+    // Tiered execution: regs and memory are guest state of CPU-Simulator and
+    // functions may be entered at loop headers through osrEntry
+    bool isExternalState_ = false;
+    GuestState guestState_{};
+    llvm::GlobalVariable* osrEntry_ = nullptr;
+    std::vector<bool> isLoopHeader_;
+
+    // Function which runs guest code from PC, it is resolved on first entry
+    struct NativeEntry {
+        std::string function;
+        bool isMain = false;
+        bool isLoopHeader = false;
+        void* address = nullptr;
+    };
+
+    std::unordered_map<size_t, NativeEntry> nativeEntries_;
+    std::unique_ptr<llvm::orc::LLJIT> jit_;
+    int32_t* osrEntryPC_ = nullptr;
+    int32_t* exitedFlag_ = nullptr;
+
+    std::unique_ptr<llvm::orc::LazyCallThroughManager> callThroughManager_;
+    std::unique_ptr<llvm::orc::IndirectStubsManager> stubsManager_;
 
-    llvm::Function* CreateFunc();
-    BranchBB CreateBranchBB(size_t truePC, size_t falsePC);
+    void FindLeaders();
+    void CreateBlocks(size_t beginPC);
+    llvm::Function* CreateFunc(size_t entryPC);
+    llvm::BasicBlock* CreateBB(size_t PC);
+    void TerminateBB();
 
     void ReadBytecode();
+    void DeclareGlobalArray(GlobalArray& GA);
     void CreateGlobalArray(GlobalArray& GA);
+    void CreateGuestArray(GlobalArray& GA);
+    void CreateOsrEntries();
 
+    void CreateFrame(llvm::Function* function, llvm::BasicBlock* entryBB);
+    void LoadFrame();
+    void StoreFrame();
+
+    void TranslateFunction(size_t entryPC);
+    llvm::orc::ThreadSafeModule TranslateLazyFunction(size_t entryPC);
     void TranslateByteCode();
     void TranslateByteCodeExpression();
-    void TranslateByteCodeJumps();
+    void TranslateByteCodeJumps(llvm::Value* isTaken = nullptr);
     void TranslateByteCodeCmp();
+    std::pair<llvm::Value*, llvm::Value*> TranslateCmpOperands();
+    void TranslateFusedInstr(const FusedInstr& fused);
     void TranslateByteCodeIO();
     void TranslateByteCodeStack();
+    void PushStack(llvm::Value* value);
+    llvm::Value* PopStack();
+    void CheckStack(llvm::Value* isError, llvm::BasicBlock*& errorBB,
+                    const char* reportFunc);
     void TranslateByteCodeCall();
     void TranslateByteCodeRet();
     void TranslateByteCodeExit();
+    llvm::BasicBlock* GetExitBB();
 
     TranslatedValue TranslateRegister(size_t PC);
+    int TranslateImmediate() const;
     llvm::Value* TranslateMemory(llvm::Value* val);
 
-    llvm::Function*   GetFunction(size_t PC) const;
+    llvm::Function*   GetFunction(size_t PC);
+    std::string GetFunctionName(size_t entryPC) const;
     llvm::BasicBlock* GetBB      (size_t PC) const;
+    size_t GetJumpTarget(size_t PC) const;
     void MovePC();
 
-    void CountTact(int idInst);
-    void PrintBenchmarkResult();
+    void StartProfile();
+    void CountBlock(size_t PC);
 
 public:
-    Impl(char*  pathToInputFile, bool isAnalyse = false) :
+    Impl(char*  pathToInputFile, bool isAnalyse = false,
+         bool isProfile = false,
+         size_t sizeBenchmark = SIZE_MEMORY_BENCHMARK,
+         size_t sizeStack = SIZE_STACK) :
         pathToInputFile_(pathToInputFile),
-        isAnalyse_(isAnalyse)
-        {}
+        sizeCallStack_(sizeStack),
+        isAnalyse_(isAnalyse),
+        isProfile_(isProfile),
+        sizeBenchmark_(sizeBenchmark)
+    {
+        stack_.size = sizeStack;
+    }
+
+    Impl(ByteSpan bytecode, bool isAnalyse = false, bool isProfile = false,
+         size_t sizeBenchmark = SIZE_MEMORY_BENCHMARK,
+         size_t sizeStack = SIZE_STACK) :
+        bytecode_(new unsigned char[bytecode.size]),
+        sizeByteCode_(bytecode.size),
+        sizeCallStack_(sizeStack),
+        isAnalyse_(isAnalyse),
+        isProfile_(isProfile),
+        sizeBenchmark_(sizeBenchmark)
+    {
+        stack_.size = sizeStack;
+        std::copy(bytecode.data, bytecode.data + bytecode.size, bytecode_);
+    }
+
+    Impl(ByteSpan bytecode, const GuestState& guestState) :
+        Impl(bytecode)
+    {
+        isExternalState_ = true;
+        guestState_ = guestState;
+    }
 
     ~Impl()
     {
@@ -185,24 +540,90 @@ public:
     void PreTranslateBenchmark();
     void PreTranslate();
 
+    void Verify() const;
+    void Optimize(unsigned optLevel);
+    void EmitObject(const std::string& pathToObject);
+    std::string GetCacheKey(unsigned optLevel) const;
+    int RunCached(const std::string& cacheDir, unsigned optLevel);
+    int Run();
+    int RunLazy(unsigned optLevel);
+    std::vector<std::unique_ptr<llvm::MemoryBuffer>>
+    CompileParallel(unsigned optLevel, unsigned nThreads);
+    int RunParallel(unsigned optLevel, unsigned nThreads);
+
+    void Compile();
+    bool HasNativeEntry(size_t PC) const;
+    bool RunFrom(size_t PC);
+
     friend void Translator::Dump() const;
 
 }; // class Translator::Impl
 
+// Body of guest function behind its lazy stub, it is translated when the
+// stub is called for the first time
+class Translator::Impl::FunctionUnit : public llvm::orc::MaterializationUnit {
+private:
+    Impl& translator_;
+    size_t entryPC_ = 0;
+
+public:
+    FunctionUnit(Impl& translator, size_t entryPC,
+                 llvm::orc::SymbolStringPtr name) :
+        MaterializationUnit(Interface(
+            {{name, llvm::JITSymbolFlags::Exported |
+                    llvm::JITSymbolFlags::Callable}}, nullptr)),
+        translator_(translator),
+        entryPC_(entryPC)
+        {}
+
+    llvm::StringRef getName() const override
+    {
+        return "GuestFunction";
+    }
+
+    void materialize(
+        std::unique_ptr<llvm::orc::MaterializationResponsibility> responsibility)
+        override
+    {
+        llvm::orc::ThreadSafeModule module;
+        try {
+            module = translator_.TranslateLazyFunction(entryPC_);
+        }
+        catch (std::exception& exception) {
+            responsibility->getExecutionSession().reportError(
+                llvm::make_error<llvm::StringError>(
+                    exception.what(), llvm::inconvertibleErrorCode()));
+            responsibility->failMaterialization();
+            return;
+        }
+
+        translator_.jit_->getIRCompileLayer().emit(std::move(responsibility),
+                                                   std::move(module));
+    }
+
+private:
+    void discard(const llvm::orc::JITDylib&,
+                 const llvm::orc::SymbolStringPtr&) override
+        {}
+}; // class Translator::Impl::FunctionUnit
+
 
 void Translator::Impl::PreTranslate()
 {
-    ReadBytecode();
+    if (bytecode_ == nullptr)
+        ReadBytecode();
 
     // Create basic
-    module_  = new llvm::Module("top", context_);
+    module_  = std::make_unique<llvm::Module>("top", context_);
     builder_ = new llvm::IRBuilder(context_);
 
+    FindLeaders();
+
     llvm::FunctionType* funcType =
             llvm::FunctionType::get(builder_->getInt32Ty(), false);
     llvm::Function* mainFunc =
             llvm::Function::Create(funcType, llvm::Function::ExternalLinkage,
-                                   "main", module_);
+                                   "main", module_.get());
 
     llvm::BasicBlock* entryBB = llvm::BasicBlock::Create(context_, "entryBB",
                                                          mainFunc);
@@ -210,21 +631,29 @@ void Translator::Impl::PreTranslate()
     builder_->SetInsertPoint(entryBB);
     curFunc_ = mainFunc;
 
-    for (; PC_ < sizeByteCode_; MovePC()) {
-        if (bytecode_[PC_] == CALL)
-            if (GetFunction(PC_ + (char)bytecode_[PC_ + 1]) == nullptr)
-                functions_.insert(std::make_pair
-                    (PC_ + (char)bytecode_[PC_ + 1], CreateFunc()));
-
-        if (IsJumpInstr(bytecode_[PC_]))
-            branchBBs_.insert(std::make_pair
-                (PC_, CreateBranchBB(PC_ + (char)bytecode_[PC_ + 1], PC_ + 2)));
+    if (isExternalState_) {
+        stack_.size = guestState_.sizeStack;
+        sizeCallStack_ = guestState_.sizeCallStack;
     }
 
-    curFunc_ = mainFunc;
+    CreateGuestArray(regs_);
+    CreateGuestArray(flag_);
+    CreateGuestArray(stack_);
+    CreateGuestArray(stackTop_);
+    CreateGuestArray(callDepth_);
+    CreateGlobalArray(exited_);
+    CreateFrame(mainFunc, entryBB);
     PC_ = 0;
 
-    CreateGlobalArray(memory_);
+    if (isExternalState_) {
+        memory_.size = guestState_.sizeMemory;
+        osrEntry_ = new llvm::GlobalVariable(
+            *module_, builder_->getInt32Ty(), false,
+            llvm::GlobalValue::ExternalLinkage,
+            llvm::ConstantInt::get(builder_->getInt32Ty(), -1, true),
+            "osrEntry");
+    }
+    CreateGuestArray(memory_);
 }
 
 void Translator::Impl::PreTranslateBenchmark()
@@ -232,47 +661,105 @@ void Translator::Impl::PreTranslateBenchmark()
     if (!isAnalyse_)
         return;
 
-    for (size_t i = 0; i < SIZE_MEMORY_BENCHMARK; i++) {
+    if (memory_.size <= sizeBenchmark_)
+        throw std::runtime_error("Translator: Memory is too small for benchmark");
+
+    // Input array is initializer of memory instead of stores in main: shared
+    // memory of lazy translation keeps stores, which are slow to optimize
+    std::vector<llvm::Constant*> input;
+    for (size_t i = 0; i < memory_.size; i++) {
         // int number = GetRandomNumber(MIN_RANDOM, MAX_RANDOM);
-        int number = memory_.size - i;
-        llvm::Value* pArg_1 = builder_->CreateConstGEP2_32(memory_.type,
-                                                           memory_.array, 0, i);
-        llvm::Value* arg_2 = llvm::ConstantInt::get(builder_->getInt32Ty(),
-                                                  number);
-        builder_->CreateStore(arg_2, pArg_1);
+        int number = (i < sizeBenchmark_) ? memory_.size - i : 0;
+        input.push_back(llvm::ConstantInt::get(builder_->getInt32Ty(), number));
     }
+    memory_.array->setInitializer(llvm::ConstantArray::get(memory_.type,
+                                                           input));
+
+    // Bounds of input array are on the stack, as CpuSimulator pushes them
+    const int bounds[] = {0, static_cast<int>(sizeBenchmark_)};
+    for (unsigned i = 0; i < std::size(bounds); i++)
+        builder_->CreateStore(
+            llvm::ConstantInt::get(builder_->getInt32Ty(), bounds[i]),
+            builder_->CreateConstGEP2_64(stack_.type, stack_.array, 0, i));
+
+    builder_->CreateStore(
+        llvm::ConstantInt::get(builder_->getInt64Ty(), std::size(bounds)),
+        curFrame_->stackTop);
+}
 
-    llvm::Value* startArrayBenchmark =
-        llvm::ConstantInt::get(builder_->getInt32Ty(), 0);
-    llvm::Value* endArrayBenchmark =
-        llvm::ConstantInt::get(builder_->getInt32Ty(), SIZE_MEMORY_BENCHMARK);
+void Translator::Impl::Translate()
+{
+    StartProfile();
+
+    // Main is created by PreTranslate() and continues its entry block
+    CreateBlocks(0);
+    TranslateByteCode();
 
-    stackIR_.push(startArrayBenchmark);
-    stackIR_.push(endArrayBenchmark);
+    for (size_t entryPC : funcEntries_)
+        TranslateFunction(entryPC);
 }
 
-void Translator::Impl::Translate()
+void Translator::Impl::TranslateFunction(size_t entryPC)
 {
-    CreateGlobalArray(regs_);
-    CreateGlobalArray(benchmarkResult_);
+    CreateFunc(entryPC);
+    CreateBlocks(entryPC);
+
+    builder_->SetInsertPoint(curFrame_->entryBB);
+    builder_->CreateBr(GetBB(entryPC));
+
     TranslateByteCode();
 }
 
+// Module of the only guest function: globals of main module are declared
+// in it and calls of other functions go to their lazy stubs
+llvm::orc::ThreadSafeModule Translator::Impl::TranslateLazyFunction(
+    size_t entryPC)
+{
+    auto lock = threadSafeContext_.getLock();
+
+    module_ = std::make_unique<llvm::Module>(GetFunctionName(entryPC),
+                                             context_);
+    DeclareGlobalArray(regs_);
+    DeclareGlobalArray(flag_);
+    DeclareGlobalArray(memory_);
+    DeclareGlobalArray(stack_);
+    DeclareGlobalArray(stackTop_);
+    DeclareGlobalArray(callDepth_);
+    DeclareGlobalArray(exited_);
+    if (isProfile_)
+        DeclareGlobalArray(blockCounts_);
+
+    TranslateFunction(entryPC);
+
+    Verify();
+    Optimize(optLevel_);
+
+    return llvm::orc::ThreadSafeModule(std::move(module_), threadSafeContext_);
+}
+
+// Translates code of current function, see CreateBlocks()
 void Translator::Impl::TranslateByteCode()
 {
-    llvm::Function* tmpFunc = nullptr;
     llvm::BasicBlock* tmpBB = nullptr;
-    while (PC_ < sizeByteCode_) {
-
-        tmpFunc = GetFunction(PC_);
-        if (tmpFunc != nullptr)
-            curFunc_ = tmpFunc;
+    for (PC_ = funcBeginPC_; PC_ < funcEndPC_;) {
 
         tmpBB = GetBB(PC_);
-        if (tmpBB != nullptr)
+        if (tmpBB != nullptr) {
+            // Fall through from the previous block of the same function
+            if (builder_->GetInsertBlock()->getTerminator() == nullptr)
+                builder_->CreateBr(tmpBB);
             builder_->SetInsertPoint(tmpBB);
+        }
+
+        if (PC_ == funcBeginPC_ || tmpBB != nullptr)
+            CountBlock(PC_);
 
-        CountTact(bytecode_[PC_]);
+        FusedInstr fused = MatchFusion(bytecode_, sizeByteCode_, PC_,
+                                       isLeader_);
+        if (fused.fusion != FUSION_NONE && PC_ + fused.size <= funcEndPC_) {
+            TranslateFusedInstr(fused);
+            continue;
+        }
 
         switch (bytecode_[PC_]) {
         case ADD_R:
@@ -290,6 +777,11 @@ void Translator::Impl::TranslateByteCode()
         case MOV_RP:
         case MOV_PR:
         case MOV_PP:
+        case MOV_W:
+        case ADD_W:
+        case SUB_W:
+        case IMUL_W:
+        case IDIV_W:
             TranslateByteCodeExpression();
             break;
 
@@ -300,6 +792,13 @@ void Translator::Impl::TranslateByteCode()
         case JLE:
         case JE:
         case JNE:
+        case JMP_W:
+        case JG_W:
+        case JGE_W:
+        case JL_W:
+        case JLE_W:
+        case JE_W:
+        case JNE_W:
             TranslateByteCodeJumps();
             break;
 
@@ -307,6 +806,7 @@ void Translator::Impl::TranslateByteCode()
         case CMP_R:
         case CMP_RP:
         case CMP_PP:
+        case CMP_W:
             TranslateByteCodeCmp();
             break;
 
@@ -318,12 +818,14 @@ void Translator::Impl::TranslateByteCode()
             break;
 
         case PUSH:
+        case PUSH_W:
         case PUSH_R:
         case POP_R:
             TranslateByteCodeStack();
             break;
 
         case CALL:
+        case CALL_W:
             TranslateByteCodeCall();
             break;
 
@@ -341,59 +843,163 @@ void Translator::Impl::TranslateByteCode()
                                      std::to_string(bytecode_[PC_]));
         }
     }
+
+    TerminateBB();
+
+    if (isExternalState_)
+        CreateOsrEntries();
 }
 
-llvm::Function* Translator::Impl::CreateFunc()
+void Translator::Impl::FindLeaders()
 {
-    static size_t numFunc = 0;
-    numFunc++;
+    isLeader_.assign(sizeByteCode_ + 1, false);
+    isFuncEntry_.assign(sizeByteCode_ + 1, false);
+    isLoopHeader_.assign(sizeByteCode_ + 1, false);
+    blocks_.assign(sizeByteCode_ + 1, nullptr);
+
+    for (size_t PC = 0; PC < sizeByteCode_; PC += GetSizeInstr(bytecode_[PC])) {
+        int idInstr = bytecode_[PC];
+        size_t nextPC = PC + GetSizeInstr(idInstr);
+
+        if (IsCallInstr(idInstr) || IsJumpInstr(idInstr)) {
+            size_t targetPC = GetJumpTarget(PC);
+            if (targetPC >= sizeByteCode_)
+                throw std::runtime_error("FindLeaders():"
+                                         "Jump out of bytecode at PC " +
+                                         std::to_string(PC));
+
+            if (IsCallInstr(idInstr))
+                isFuncEntry_[targetPC] = true;
+            else
+                isLeader_[targetPC] = true;
+
+            if (isExternalState_ && !IsCallInstr(idInstr) && targetPC <= PC)
+                isLoopHeader_[targetPC] = true;
+        }
 
-    llvm::FunctionType* funcType =
-        llvm::FunctionType::get(builder_->getVoidTy(), false);
-    llvm::Function* function =
-        llvm::Function::Create(funcType, llvm::Function::ExternalLinkage,
-                                "Function" + std::to_string(numFunc), module_);
+        if (IsJumpInstr(idInstr) || IsTerminatorInstr(idInstr))
+            isLeader_[nextPC] = true;
+    }
+
+    funcEntries_.clear();
+    for (size_t PC = 0; PC < sizeByteCode_; PC += GetSizeInstr(bytecode_[PC]))
+        if (isFuncEntry_[PC])
+            funcEntries_.push_back(PC);
+
+    // Entry block of main has to end with a branch, which may become
+    // dispatch over loop headers
+    if (isExternalState_)
+        isLeader_[0] = true;
+}
+
+// Guest function owns code from its entry up to the next function entry,
+// main - up to the first one. Basic blocks are created for leaders of the
+// function which starts at beginPC, it becomes current for GetBB().
+void Translator::Impl::CreateBlocks(size_t beginPC)
+{
+    funcBeginPC_ = beginPC;
+    auto nextEntry = std::upper_bound(funcEntries_.begin(), funcEntries_.end(),
+                                      beginPC);
+    funcEndPC_ = (nextEntry != funcEntries_.end()) ? *nextEntry
+                                                   : sizeByteCode_;
+
+    for (size_t PC = funcBeginPC_; PC < funcEndPC_;
+         PC += GetSizeInstr(bytecode_[PC]))
+        blocks_[PC] = (isLeader_[PC] || isFuncEntry_[PC]) ? CreateBB(PC)
+                                                          : nullptr;
+}
+
+llvm::Function* Translator::Impl::CreateFunc(size_t entryPC)
+{
+    llvm::Function* function = GetFunction(entryPC);
 
     curFunc_ = function;
-    size_t startFuncPC = PC_ + (char)bytecode_[PC_ + 1];
-    branchBBs_.insert(std::make_pair(startFuncPC, CreateBranchBB(startFuncPC,
-                                                                 startFuncPC)));
+    llvm::BasicBlock* entryBB = llvm::BasicBlock::Create(context_, "entry",
+                                                         function);
+    CreateFrame(function, entryBB);
 
     return function;
 }
 
-Translator::Impl::BranchBB Translator::Impl::CreateBranchBB(size_t truePC,
-                                                            size_t falsePC)
+llvm::BasicBlock* Translator::Impl::CreateBB(size_t PC)
 {
-    static size_t numBB = 0;
-    numBB++;
+    return llvm::BasicBlock::Create(context_, "BB" + std::to_string(PC),
+                                    curFunc_);
+}
 
-    BranchBB branchBB;
+// Guest code must not fall through into the next function
+void Translator::Impl::TerminateBB()
+{
+    if (builder_->GetInsertBlock()->getTerminator() == nullptr)
+        builder_->CreateUnreachable();
+}
 
-    llvm::BasicBlock* tmpTrueBB = GetBB(truePC);
-    if (tmpTrueBB == nullptr)
-        branchBB.trueBB =
-            llvm::BasicBlock::Create(context_,
-                                     "trueBB" + std::to_string(numBB),
-                                     curFunc_);
-    else
-        branchBB.trueBB = tmpTrueBB;
-    branchBB.truePC = truePC;
-
-    if (truePC == falsePC || bytecode_[PC_] == JMP)
-        return branchBB;
-
-    llvm::BasicBlock* tmpFalseBB = GetBB(falsePC);
-    if (tmpFalseBB == nullptr)
-        branchBB.falseBB =
-            llvm::BasicBlock::Create(context_,
-                                     "falseBB" + std::to_string(numBB),
-                                     curFunc_);
-    else
-        branchBB.falseBB = tmpFalseBB;
-    branchBB.falsePC = falsePC;
+void Translator::Impl::CreateFrame(llvm::Function* function,
+                                   llvm::BasicBlock* entryBB)
+{
+    llvm::IRBuilderBase::InsertPointGuard guard(*builder_);
+    builder_->SetInsertPoint(entryBB);
+
+    // Function of lazily translated module may get address of a freed one,
+    // nothing of the old frame may be reused
+    GuestFrame& frame = frames_[function];
+    frame = GuestFrame{};
+    frame.entryBB = entryBB;
+
+    const char* regNames[N_REGS] = {"EAX", "EBX", "ECX", "EDX"};
+    for (int iReg = 0; iReg < N_REGS; iReg++)
+        frame.regs[iReg] = builder_->CreateAlloca(builder_->getInt32Ty(),
+                                                  nullptr, regNames[iReg]);
+    frame.stackTop = builder_->CreateAlloca(builder_->getInt64Ty(), nullptr,
+                                            "SP");
+    frame.flag = builder_->CreateAlloca(builder_->getInt32Ty(), nullptr,
+                                        "FLAG");
+
+    curFrame_ = &frame;
+    LoadFrame();
+}
 
-    return branchBB;
+void Translator::Impl::LoadFrame()
+{
+    for (int iReg = 0; iReg < N_REGS; iReg++) {
+        llvm::Value* pReg = builder_->CreateConstGEP2_32(regs_.type,
+                                                         regs_.array, 0, iReg);
+        builder_->CreateStore(
+            builder_->CreateLoad(builder_->getInt32Ty(), pReg),
+            curFrame_->regs[iReg]);
+    }
+
+    llvm::Value* pTop = builder_->CreateConstGEP2_32(stackTop_.type,
+                                                     stackTop_.array, 0, 0);
+    builder_->CreateStore(builder_->CreateLoad(builder_->getInt64Ty(), pTop),
+                          curFrame_->stackTop);
+
+    llvm::Value* pFlag = builder_->CreateConstGEP2_32(flag_.type, flag_.array,
+                                                      0, 0);
+    builder_->CreateStore(builder_->CreateLoad(builder_->getInt32Ty(), pFlag),
+                          curFrame_->flag);
+}
+
+void Translator::Impl::StoreFrame()
+{
+    for (int iReg = 0; iReg < N_REGS; iReg++) {
+        llvm::Value* pReg = builder_->CreateConstGEP2_32(regs_.type,
+                                                         regs_.array, 0, iReg);
+        builder_->CreateStore(
+            builder_->CreateLoad(builder_->getInt32Ty(), curFrame_->regs[iReg]),
+            pReg);
+    }
+
+    llvm::Value* pTop = builder_->CreateConstGEP2_32(stackTop_.type,
+                                                     stackTop_.array, 0, 0);
+    builder_->CreateStore(
+        builder_->CreateLoad(builder_->getInt64Ty(), curFrame_->stackTop),
+        pTop);
+
+    llvm::Value* pFlag = builder_->CreateConstGEP2_32(flag_.type, flag_.array,
+                                                      0, 0);
+    builder_->CreateStore(
+        builder_->CreateLoad(builder_->getInt32Ty(), curFrame_->flag), pFlag);
 }
 
 void Translator::Impl::TranslateByteCodeExpression()
@@ -405,14 +1011,14 @@ void Translator::Impl::TranslateByteCodeExpression()
         arg_2 = TranslateRegister(PC_ + 2);
     else
         arg_2.val = llvm::ConstantInt::get(builder_->getInt32Ty(),
-                                            bytecode_[PC_ + 2]);
+                                           TranslateImmediate(), true);
 
     llvm::Value* res = nullptr;
     switch (bytecode_[PC_]) {
     case MOV_PP:
         arg_1.ptr = TranslateMemory(arg_1.val);
         arg_2.ptr = TranslateMemory(arg_2.val);
-        res = builder_->CreateLoad(arg_2.ptr);
+        res = builder_->CreateLoad(builder_->getInt32Ty(), arg_2.ptr);
         break;
 
     case MOV_PR:
@@ -422,25 +1028,29 @@ void Translator::Impl::TranslateByteCodeExpression()
 
     case MOV_RP:
         arg_2.ptr = TranslateMemory(arg_2.val);
-        res = builder_->CreateLoad(arg_2.ptr);
+        res = builder_->CreateLoad(builder_->getInt32Ty(), arg_2.ptr);
         break;
 
     case ADD:
+    case ADD_W:
     case ADD_R:
         res = builder_->CreateAdd(arg_1.val, arg_2.val);
         break;
 
     case SUB:
+    case SUB_W:
     case SUB_R:
         res = builder_->CreateSub(arg_1.val, arg_2.val);
         break;
 
     case IMUL:
+    case IMUL_W:
     case IMUL_R:
         res = builder_->CreateMul(arg_1.val, arg_2.val);
         break;
 
     case IDIV:
+    case IDIV_W:
     case IDIV_R:
         res = builder_->CreateSDiv(arg_1.val, arg_2.val);
         break;
@@ -456,6 +1066,7 @@ void Translator::Impl::TranslateByteCodeExpression()
         break;
 
     case MOV:
+    case MOV_W:
     case MOV_R:
         res = arg_2.val;
         break;
@@ -471,19 +1082,49 @@ void Translator::Impl::TranslateByteCodeExpression()
     MovePC();
 }
 
-void Translator::Impl::TranslateByteCodeJumps()
+// Conditional jump tests flag unless superinstruction passes isTaken
+void Translator::Impl::TranslateByteCodeJumps(llvm::Value* isTaken)
 {
-    llvm::BasicBlock* trueBB = GetBB(PC_ + (char)bytecode_[PC_ + 1]);
-    llvm::BasicBlock* falseBB = GetBB(PC_ + 2);
-    if (bytecode_[PC_] == JMP)
+    llvm::BasicBlock* trueBB = GetBB(GetJumpTarget(PC_));
+    llvm::BasicBlock* falseBB = GetBB(PC_ + GetSizeInstr(bytecode_[PC_]));
+
+    if (trueBB == nullptr || trueBB->getParent() != curFunc_)
+        throw std::runtime_error("TranslateByteCodeJumps():"
+                                 "Invalid jump target at PC " +
+                                 std::to_string(PC_));
+    if (bytecode_[PC_] == JMP || bytecode_[PC_] == JMP_W) {
         builder_->CreateBr(trueBB);
-    else
-        builder_->CreateCondBr(curCmpValue_, trueBB, falseBB);
+        MovePC();
+        return;
+    }
+
+    if (falseBB == nullptr)
+        throw std::runtime_error("TranslateByteCodeJumps():"
+                                 "Jump falls through out of function at PC " +
+                                 std::to_string(PC_));
+
+    if (isTaken == nullptr) {
+        llvm::Value* flag = builder_->CreateLoad(builder_->getInt32Ty(),
+                                                 curFrame_->flag);
+        isTaken = builder_->CreateICmp(
+            GetPredicate(GetJumpCondition(bytecode_[PC_])), flag,
+            builder_->getInt32(0), "resCmp");
+    }
+    builder_->CreateCondBr(isTaken, trueBB, falseBB);
 
     MovePC();
 }
 
+// Flag is a wrapped difference as GetCompareFlag() of CPU-Simulator, jumps
+// test its sign even if it overflows
 void Translator::Impl::TranslateByteCodeCmp()
+{
+    auto [arg_1, arg_2] = TranslateCmpOperands();
+    builder_->CreateStore(builder_->CreateSub(arg_1, arg_2), curFrame_->flag);
+    MovePC();
+}
+
+std::pair<llvm::Value*, llvm::Value*> Translator::Impl::TranslateCmpOperands()
 {
     TranslatedValue arg_1 = TranslateRegister(PC_ + 1);
 
@@ -492,64 +1133,63 @@ void Translator::Impl::TranslateByteCodeCmp()
         arg_2 = TranslateRegister(PC_ + 2);
     else
         arg_2.val = llvm::ConstantInt::get(builder_->getInt32Ty(),
-                                       bytecode_[PC_ + 2]);
+                                           TranslateImmediate(), true);
 
     switch (bytecode_[PC_]) {
         case CMP_PP:
             arg_1.ptr = TranslateMemory(arg_1.val);
-            arg_1.val = builder_->CreateLoad(arg_1.ptr);
+            arg_1.val = builder_->CreateLoad(builder_->getInt32Ty(), arg_1.ptr);
+            [[fallthrough]];
         case CMP_RP:
             arg_2.ptr = TranslateMemory(arg_2.val);
-            arg_2.val = builder_->CreateLoad(arg_2.ptr);
+            arg_2.val = builder_->CreateLoad(builder_->getInt32Ty(), arg_2.ptr);
             break;
     }
 
-    llvm::CmpInst::Predicate predicate;
-    switch (bytecode_[PC_ + 3]) {
-        case JMP: return;
-        case JG:  predicate = llvm::CmpInst::Predicate::ICMP_SGT;  break;
-        case JGE: predicate = llvm::CmpInst::Predicate::ICMP_SGE;  break;
-        case JL:  predicate = llvm::CmpInst::Predicate::ICMP_SLT;  break;
-        case JLE: predicate = llvm::CmpInst::Predicate::ICMP_SLE;  break;
-        case JE:  predicate = llvm::CmpInst::Predicate::ICMP_EQ;   break;
-        case JNE: predicate = llvm::CmpInst::Predicate::ICMP_NE;   break;
-        default:
-            throw std::runtime_error("TranslateByteCodeCmp():"
-                                     "Jump instruction is not found");
-    }
+    return {arg_1.val, arg_2.val};
+}
 
-    curCmpValue_ = builder_->CreateCmp(predicate, arg_1.val, arg_2.val,
-                                       "resCmp");
-    MovePC();
+// Superinstruction of Fusion.h: jump tests the difference at once instead
+// of loading flag, which is still written for jumps after it
+void Translator::Impl::TranslateFusedInstr(const FusedInstr& fused)
+{
+    if (fused.cmpPC != PC_)
+        TranslateByteCodeExpression();
+
+    auto [arg_1, arg_2] = TranslateCmpOperands();
+    llvm::Value* flag = builder_->CreateSub(arg_1, arg_2);
+    builder_->CreateStore(flag, curFrame_->flag);
+    llvm::Value* isTaken = builder_->CreateICmp(
+        GetPredicate(fused.condition), flag, builder_->getInt32(0), "resCmp");
+
+    PC_ = fused.jumpPC;
+    TranslateByteCodeJumps(isTaken);
 }
 
+// Guest I/O goes through buffered runtime shared with CPU-Simulator
 void Translator::Impl::TranslateByteCodeIO()
 {
-    std::vector<llvm::Type *> funcArgsTypes;
-    funcArgsTypes.push_back(builder_->getInt8PtrTy());
-    llvm::FunctionType* funcType =
-                                 llvm::FunctionType::get(builder_->getInt32Ty(),
-                                                         funcArgsTypes, true);
+    llvm::FunctionCallee writeFunc =
+        module_->getOrInsertFunction("RuntimeWrite", builder_->getVoidTy(),
+                                     builder_->getInt32Ty());
+    llvm::FunctionCallee readFunc =
+        module_->getOrInsertFunction("RuntimeRead", builder_->getInt32Ty());
 
-    std::string formatStr("%d");
-    llvm::FunctionCallee func;
-    llvm::FunctionCallee printfReg = module_->getOrInsertFunction("printf",
-                                                                  funcType);
     TranslatedValue arg = TranslateRegister(PC_ + 1);
     switch (bytecode_[PC_]) {
     case WRITE_P:
         arg.ptr = TranslateMemory(arg.val);
+        arg.val = builder_->CreateLoad(builder_->getInt32Ty(), arg.ptr);
+        [[fallthrough]];
     case WRITE:
-        arg.val = builder_->CreateLoad(arg.ptr);
-        func = printfReg;
-        formatStr += "\n";
+        builder_->CreateCall(writeFunc, {arg.val});
         break;
 
     case READ_P:
         arg.ptr = TranslateMemory(arg.val);
+        [[fallthrough]];
     case READ:
-        arg.val = arg.ptr;
-        func = module_->getOrInsertFunction("scanf", funcType);
+        builder_->CreateStore(builder_->CreateCall(readFunc), arg.ptr);
         break;
 
     default:
@@ -558,70 +1198,24 @@ void Translator::Impl::TranslateByteCodeIO()
                                  + std::to_string(bytecode_[PC_]));
     }
 
-    std::string regStr;
-    switch (bytecode_[PC_ + 1]) {
-    case EAX:
-        regStr += "EAX: = ";
-        break;
-    case EBX:
-        regStr += "EBX: = ";
-        break;
-    case ECX:
-        regStr += "ECX: = ";
-        break;
-    case EDX:
-        regStr += "RDX: = ";
-        break;
-
-    default:
-        throw std::runtime_error("TranslateByteCodeIO():"
-                                 "Undefined instruction" +
-                                 std::to_string(bytecode_[PC_ + 1]));
-    }
-    llvm::Value* formatRegStrVal =
-        builder_->CreateGlobalStringPtr(regStr, "IORegister");
-    llvm::Value* formatStrVal =
-        builder_->CreateGlobalStringPtr(formatStr, "IOformat");
-
-    std::vector<llvm::Value *> args;
-    args.push_back(formatRegStrVal);
-    builder_->CreateCall(printfReg, args);
-
-    args.clear();
-
-    args.push_back(formatStrVal);
-    args.push_back(arg.val);
-
-    builder_->CreateCall(func, args);
-
     MovePC();
 }
 
 void Translator::Impl::TranslateByteCodeStack()
 {
-    llvm::Value* pArg = nullptr;
-    llvm::Value* arg = nullptr;
-
     switch (bytecode_[PC_]) {
     case PUSH:
-        arg = llvm::ConstantInt::get(builder_->getInt32Ty(),
-                                     (char)bytecode_[PC_ + 1]);
-        stackIR_.push(arg);
+    case PUSH_W:
+        PushStack(llvm::ConstantInt::get(builder_->getInt32Ty(),
+                                         TranslateImmediate(), true));
         break;
 
     case PUSH_R:
-        pArg = builder_->CreateConstGEP2_32(regs_.type, regs_.array, 0,
-                                            bytecode_[PC_ + 1]);
-        arg = builder_->CreateLoad(pArg);
-        stackIR_.push(arg);
+        PushStack(TranslateRegister(PC_ + 1).val);
         break;
 
     case POP_R:
-        pArg = builder_->CreateConstGEP2_32(regs_.type, regs_.array, 0,
-                                            bytecode_[PC_ + 1]);
-        arg = stackIR_.top();
-        builder_->CreateStore(arg, pArg);
-        stackIR_.pop();
+        builder_->CreateStore(PopStack(), TranslateRegister(PC_ + 1).ptr);
         break;
 
     default:
@@ -633,42 +1227,210 @@ void Translator::Impl::TranslateByteCodeStack()
     MovePC();
 }
 
+// Guest stack lives in memory of stack, but its top is a value of frame:
+// after promotion to SSA LLVM sees push and pop of one function as accesses
+// to the same slot and forwards values between them
+void Translator::Impl::PushStack(llvm::Value* value)
+{
+    llvm::Value* top = builder_->CreateLoad(builder_->getInt64Ty(),
+                                            curFrame_->stackTop);
+    CheckStack(builder_->CreateICmpUGE(
+                   top, llvm::ConstantInt::get(builder_->getInt64Ty(),
+                                               stack_.size)),
+               curFrame_->overflowBB, "RuntimeStackOverflow");
+
+    llvm::Value* zero = llvm::ConstantInt::get(builder_->getInt64Ty(), 0);
+    builder_->CreateStore(value, builder_->CreateInBoundsGEP(
+                                     stack_.type, stack_.array, {zero, top}));
+    builder_->CreateStore(builder_->CreateNUWAdd(
+                              top, llvm::ConstantInt::get(
+                                       builder_->getInt64Ty(), 1)),
+                          curFrame_->stackTop);
+}
+
+llvm::Value* Translator::Impl::PopStack()
+{
+    llvm::Value* top = builder_->CreateLoad(builder_->getInt64Ty(),
+                                            curFrame_->stackTop);
+    CheckStack(builder_->CreateICmpEQ(
+                   top, llvm::ConstantInt::get(builder_->getInt64Ty(), 0)),
+               curFrame_->underflowBB, "RuntimeStackUnderflow");
+
+    top = builder_->CreateNUWSub(
+        top, llvm::ConstantInt::get(builder_->getInt64Ty(), 1));
+    builder_->CreateStore(top, curFrame_->stackTop);
+
+    llvm::Value* zero = llvm::ConstantInt::get(builder_->getInt64Ty(), 0);
+    return builder_->CreateLoad(builder_->getInt32Ty(),
+                                builder_->CreateInBoundsGEP(
+                                    stack_.type, stack_.array, {zero, top}));
+}
+
+// Branches to errorBB of frame, which stops guest program with reportFunc,
+// and continues translation in a new block
+void Translator::Impl::CheckStack(llvm::Value* isError,
+                                  llvm::BasicBlock*& errorBB,
+                                  const char* reportFunc)
+{
+    if (errorBB == nullptr) {
+        llvm::IRBuilderBase::InsertPointGuard guard(*builder_);
+        errorBB = llvm::BasicBlock::Create(context_, reportFunc, curFunc_);
+        builder_->SetInsertPoint(errorBB);
+
+        llvm::FunctionCallee report =
+            module_->getOrInsertFunction(reportFunc, builder_->getVoidTy());
+        llvm::cast<llvm::Function>(report.getCallee())->setDoesNotReturn();
+        builder_->CreateCall(report);
+        builder_->CreateUnreachable();
+    }
+
+    llvm::BasicBlock* continueBB = llvm::BasicBlock::Create(context_, "",
+                                                            curFunc_);
+    builder_->CreateCondBr(isError, errorBB, continueBB,
+                           llvm::MDBuilder(context_).createBranchWeights(
+                               1, UINT16_MAX));
+    builder_->SetInsertPoint(continueBB);
+}
+
+// Guest call is a native call, its depth is checked against capacity of
+// return stack, so runaway recursion stops as in CPU-Simulator instead of
+// overflowing the host stack
 void Translator::Impl::TranslateByteCodeCall()
 {
-    llvm::Function* function = GetFunction(PC_ + (char)bytecode_[PC_ + 1]);
+    llvm::Value* pDepth = builder_->CreateConstGEP2_32(callDepth_.type,
+                                                       callDepth_.array, 0, 0);
+    llvm::Value* depth = builder_->CreateLoad(builder_->getInt64Ty(), pDepth);
+    CheckStack(builder_->CreateICmpUGE(
+                   depth, llvm::ConstantInt::get(builder_->getInt64Ty(),
+                                                 sizeCallStack_)),
+               curFrame_->overflowBB, "RuntimeStackOverflow");
+    builder_->CreateStore(builder_->CreateNUWAdd(
+                              depth, llvm::ConstantInt::get(
+                                         builder_->getInt64Ty(), 1)),
+                          pDepth);
+
+    llvm::Function* function = GetFunction(GetJumpTarget(PC_));
+    StoreFrame();
     builder_->CreateCall(function);
+    LoadFrame();
+
+    builder_->CreateStore(depth, pDepth);
+
+    llvm::Value* pExited = builder_->CreateConstGEP2_32(exited_.type,
+                                                        exited_.array, 0, 0);
+    llvm::Value* isExited = builder_->CreateICmpNE(
+        builder_->CreateLoad(builder_->getInt32Ty(), pExited),
+        builder_->getInt32(0));
+    llvm::BasicBlock* continueBB = llvm::BasicBlock::Create(context_, "",
+                                                            curFunc_);
+    builder_->CreateCondBr(isExited, GetExitBB(), continueBB,
+                           llvm::MDBuilder(context_).createBranchWeights(
+                               1, UINT16_MAX));
+    builder_->SetInsertPoint(continueBB);
 
     MovePC();
 }
 
 void Translator::Impl::TranslateByteCodeRet()
 {
+    StoreFrame();
     builder_->CreateRetVoid();
     MovePC();
 }
 
 void Translator::Impl::TranslateByteCodeExit()
 {
-    PrintBenchmarkResult();
-    builder_->CreateRet(llvm::ConstantInt::get(builder_->getInt32Ty(), 0));
+    StoreFrame();
+    builder_->CreateBr(GetExitBB());
     MovePC();
 }
 
+// Guest state is stored before exit block is reached: by exit itself or by
+// guest function which exited inside of call
+llvm::BasicBlock* Translator::Impl::GetExitBB()
+{
+    GuestFrame& frame = *curFrame_;
+    if (frame.exitBB != nullptr)
+        return frame.exitBB;
+
+    llvm::IRBuilderBase::InsertPointGuard guard(*builder_);
+    frame.exitBB = llvm::BasicBlock::Create(context_, "exit", curFunc_);
+    builder_->SetInsertPoint(frame.exitBB);
+
+    if (curFunc_->getName() != "main") {
+        builder_->CreateStore(builder_->getInt32(1),
+                              builder_->CreateConstGEP2_32(exited_.type,
+                                                           exited_.array,
+                                                           0, 0));
+        builder_->CreateRetVoid();
+        return frame.exitBB;
+    }
+
+    builder_->CreateCall(
+        module_->getOrInsertFunction("RuntimeFlush", builder_->getVoidTy()));
+    if (isProfile_)
+        builder_->CreateCall(module_->getOrInsertFunction(
+            "RuntimeReportProfile", builder_->getVoidTy()));
+    builder_->CreateRet(llvm::ConstantInt::get(builder_->getInt32Ty(), 0));
+    return frame.exitBB;
+}
+
 Translator::Impl::TranslatedValue Translator::Impl::TranslateRegister(size_t PC)
 {
+    if (bytecode_[PC] >= N_REGS)
+        throw std::runtime_error("TranslateRegister():"
+                                 "Undefined register " +
+                                 std::to_string(bytecode_[PC]));
+
     TranslatedValue arg{};
-    arg.ptr    = builder_->CreateConstGEP2_32(regs_.type, regs_.array,
-                                              0, bytecode_[PC]);
-    arg.val  = builder_->CreateLoad(arg.ptr);
+    arg.ptr  = curFrame_->regs[bytecode_[PC]];
+    arg.val  = builder_->CreateLoad(builder_->getInt32Ty(), arg.ptr);
 
     return arg;
 }
 
+int Translator::Impl::TranslateImmediate() const
+{
+    return GetImmediate(bytecode_ + PC_, GetArgtypeInstr(bytecode_[PC_]));
+}
+
+// Guest address is checked like Memory() of CPU-Simulator: out of bounds
+// it goes to error block of frame, which stops guest program with
+// RuntimeInvalidAddress(), translation continues in a new block
 llvm::Value* Translator::Impl::TranslateMemory(llvm::Value* val)
 {
-    llvm::Value* tmp = llvm::ConstantInt::get(builder_->getInt32Ty(), 0);
-    llvm::ArrayRef<llvm::Value*> idxList = {tmp, val};
-    return builder_->CreateGEP(memory_.type, memory_.array, idxList);
+    GuestFrame& frame = *curFrame_;
+    if (frame.invalidAddressBB == nullptr) {
+        llvm::IRBuilderBase::InsertPointGuard guard(*builder_);
+        frame.invalidAddressBB = llvm::BasicBlock::Create(
+            context_, "RuntimeInvalidAddress", curFunc_);
+        builder_->SetInsertPoint(frame.invalidAddressBB);
+        frame.invalidAddress = builder_->CreatePHI(builder_->getInt32Ty(), 1,
+                                                   "address");
+
+        llvm::FunctionCallee report = module_->getOrInsertFunction(
+            "RuntimeInvalidAddress", builder_->getVoidTy(),
+            builder_->getInt32Ty());
+        llvm::cast<llvm::Function>(report.getCallee())->setDoesNotReturn();
+        builder_->CreateCall(report, {frame.invalidAddress});
+        builder_->CreateUnreachable();
+    }
+
+    // Negative address is a huge unsigned one
+    llvm::Value* isError = builder_->CreateICmpUGE(
+        val, llvm::ConstantInt::get(builder_->getInt32Ty(), memory_.size));
+    frame.invalidAddress->addIncoming(val, builder_->GetInsertBlock());
+
+    llvm::BasicBlock* continueBB = llvm::BasicBlock::Create(context_, "",
+                                                            curFunc_);
+    builder_->CreateCondBr(isError, frame.invalidAddressBB, continueBB,
+                           llvm::MDBuilder(context_).createBranchWeights(
+                               1, UINT16_MAX));
+    builder_->SetInsertPoint(continueBB);
+
+    llvm::Value* zero = llvm::ConstantInt::get(builder_->getInt32Ty(), 0);
+    return builder_->CreateInBoundsGEP(memory_.type, memory_.array,
+                                       {zero, val});
 }
 
 // End of functions
@@ -692,129 +1454,482 @@ void Translator::Impl::ReadBytecode()
     fclose(inputFile);
 }
 
-void Translator::Impl::CreateGlobalArray(GlobalArray& GA)
+// Global array defined outside of module
+void Translator::Impl::DeclareGlobalArray(GlobalArray& GA)
 {
-    GA.type = llvm::ArrayType::get(builder_->getInt32Ty(), GA.size);
+    GA.type = llvm::ArrayType::get(builder_->getIntNTy(GA.bits), GA.size);
     module_->getOrInsertGlobal(GA.name, GA.type);
     GA.array = module_->getNamedGlobal(GA.name);
+}
 
-    std::vector<llvm::Constant *> temp;
-    for (size_t i = 0; i < GA.size; i++)
-        temp.push_back(llvm::ConstantInt::get(builder_->getInt32Ty(), 0));
-
-    GA.array->setInitializer(llvm::ConstantArray::get(GA.type, temp));
+void Translator::Impl::CreateGlobalArray(GlobalArray& GA)
+{
+    DeclareGlobalArray(GA);
+    // Guest state is invisible outside of module, so optimizer may promote
+    // it. Lazily translated functions share it with main module by name,
+    // RunFrom() of tiered execution reads it.
+    if (!isLazy_ && !isExternalState_)
+        GA.array->setLinkage(llvm::GlobalValue::InternalLinkage);
+
+    GA.array->setInitializer(llvm::ConstantAggregateZero::get(GA.type));
 }
 
-void Translator::Impl::MovePC()
+// Guest state is owned by module or, in tiered execution, by CPU-Simulator:
+// then it is only declared here and bound to host arrays by Compile()
+void Translator::Impl::CreateGuestArray(GlobalArray& GA)
 {
-    #define INSTRUCTION(name, id, argType, num, size, code)  \
-        case id: PC_ += size; break;                         \
+    if (isExternalState_)
+        DeclareGlobalArray(GA);
+    else
+        CreateGlobalArray(GA);
+}
 
-    #define INSTRUCTIONS
-    switch (bytecode_[PC_]) {
-    #include "Commands_DSL.txt"
+// Entry block of function with loop headers dispatches on osrEntry: it is
+// set by RunFrom() to transfer control into the middle of a hot loop and is
+// reset on entry, so nested calls start from the beginning
+void Translator::Impl::CreateOsrEntries()
+{
+    std::string function = curFunc_->getName().str();
+    if (isFuncEntry_[funcBeginPC_])
+        nativeEntries_[funcBeginPC_] = {function};
+
+    for (size_t PC = funcBeginPC_; PC < funcEndPC_;
+         PC += GetSizeInstr(bytecode_[PC])) {
+        if (!isLoopHeader_[PC])
+            continue;
+
+        llvm::BasicBlock* entryBB = curFrame_->entryBB;
+        auto* dispatch = llvm::dyn_cast<llvm::SwitchInst>(
+            entryBB->getTerminator());
+        if (dispatch == nullptr) {
+            llvm::Instruction* branch = entryBB->getTerminator();
+            llvm::BasicBlock* startBB = branch->getSuccessor(0);
+            branch->eraseFromParent();
+
+            builder_->SetInsertPoint(entryBB);
+            llvm::Value* entryPC = builder_->CreateLoad(builder_->getInt32Ty(),
+                                                        osrEntry_, "osrEntry");
+            builder_->CreateStore(
+                llvm::ConstantInt::get(builder_->getInt32Ty(), -1, true),
+                osrEntry_);
+            dispatch = builder_->CreateSwitch(entryPC, startBB);
+        }
+        dispatch->addCase(llvm::ConstantInt::get(builder_->getInt32Ty(), PC),
+                          GetBB(PC));
 
-    default:
-        throw std::runtime_error("TranslateByteCode():Unidefined instruction" +
-                                 std::to_string(bytecode_[PC_]));
+        NativeEntry& entry = nativeEntries_[PC];
+        entry.function = function;
+        entry.isMain = (function == "main");
+        entry.isLoopHeader = true;
     }
+}
 
-    #undef INSTRUCTIONS
-    #undef INSTRUCTION
+void Translator::Impl::MovePC()
+{
+    PC_ += GetSizeInstr(bytecode_[PC_]);
 }
 
-void Translator::Impl::CountTact(int idInst)
+// Counters of basic blocks are indexed by PC of their first instruction.
+// Runtime expands them into profile at exit of guest program, so main
+// hands it a copy of bytecode together with counters.
+void Translator::Impl::StartProfile()
 {
-    if (!isAnalyse_)
+    if (!isProfile_)
         return;
 
-    llvm::Value* arg_2 = llvm::ConstantInt::get(builder_->getInt32Ty(), 1);
+    blockCounts_.size = sizeByteCode_;
+    CreateGlobalArray(blockCounts_);
+
+    llvm::Constant* bytecode = llvm::ConstantDataArray::get(
+        context_, llvm::ArrayRef<uint8_t>(bytecode_, sizeByteCode_));
+    llvm::GlobalVariable* profileByteCode = new llvm::GlobalVariable(
+        *module_, bytecode->getType(), true,
+        llvm::GlobalValue::InternalLinkage, bytecode, "profileByteCode");
+
+    llvm::FunctionCallee startProfile = module_->getOrInsertFunction(
+        "RuntimeStartProfile", builder_->getVoidTy(), builder_->getInt8PtrTy(),
+        builder_->getInt64Ty(), builder_->getInt64Ty()->getPointerTo());
+
+    builder_->CreateCall(startProfile, {
+        builder_->CreateConstInBoundsGEP2_64(bytecode->getType(),
+                                             profileByteCode, 0, 0),
+        builder_->getInt64(sizeByteCode_),
+        builder_->CreateConstInBoundsGEP2_64(blockCounts_.type,
+                                             blockCounts_.array, 0, 0)});
+}
 
-    llvm::Value* pArg_1 =
-            builder_->CreateConstGEP2_32(benchmarkResult_.type,
-                                         benchmarkResult_.array,
-                                         0, GetNumberIdInstr(idInst));
-    llvm::Value* arg_1 = builder_->CreateLoad(pArg_1);
-    builder_->CreateStore(builder_->CreateAdd(arg_1, arg_2), pArg_1);
+// The only instrumentation of profile: one increment per executed block
+void Translator::Impl::CountBlock(size_t PC)
+{
+    if (!isProfile_)
+        return;
 
-    pArg_1 =
-            builder_->CreateConstGEP2_32(benchmarkResult_.type,
-                                         benchmarkResult_.array,
-                                         0, N_INST);
-    arg_1 = builder_->CreateLoad(pArg_1);
-    builder_->CreateStore(builder_->CreateAdd(arg_1, arg_2), pArg_1);
+    llvm::Value* pCount = builder_->CreateConstGEP2_64(blockCounts_.type,
+                                                       blockCounts_.array,
+                                                       0, PC);
+    llvm::Value* count = builder_->CreateLoad(builder_->getInt64Ty(), pCount);
+    builder_->CreateStore(builder_->CreateAdd(count, builder_->getInt64(1)),
+                          pCount);
 }
 
-void Translator::Impl::PrintBenchmarkResult()
+
+// Blocks of current function only, the others are out of reach of jumps
+llvm::BasicBlock* Translator::Impl::GetBB(size_t PC) const
 {
-    if (!isAnalyse_)
-        return;
+    if (PC >= funcBeginPC_ && PC < funcEndPC_)
+        return blocks_[PC];
 
-    std::vector<llvm::Type *> funcArgsTypes;
-    funcArgsTypes.push_back(builder_->getInt8PtrTy());
-    llvm::FunctionType *funcType =
-        llvm::FunctionType::get(builder_->getInt32Ty(),
-                                funcArgsTypes, true);
+    return nullptr;
+}
 
-    llvm::FunctionCallee func = module_->getOrInsertFunction("printf",
-                                                             funcType);
+// Guest function is found by name, so a call may precede its translation
+llvm::Function* Translator::Impl::GetFunction(size_t PC)
+{
+    if (PC >= isFuncEntry_.size() || !isFuncEntry_[PC])
+        return nullptr;
 
-    std::string formatStr{"\n\n[Result of Benchmark]\nVer 1.0.0\n"
-                                "Number of tacts of each instruction:\n"};
-    #define INSTRUCTION(name, id, argType, num, size, code)  \
-        formatStr += "\t";                                   \
-        formatStr += #name;                                  \
-        formatStr += " - %d\n";                              \
+    std::string name = GetFunctionName(PC);
+    llvm::Function* function = module_->getFunction(name);
+    if (function != nullptr)
+        return function;
 
-    #define INSTRUCTIONS
-    #include "Commands_DSL.txt"
+    llvm::FunctionType* funcType =
+        llvm::FunctionType::get(builder_->getVoidTy(), false);
+    return llvm::Function::Create(funcType, llvm::Function::ExternalLinkage,
+                                  name, module_.get());
+}
 
-    #undef INSTRUCTIONS
-    #undef INSTRUCTION
-    formatStr += "\n\tTotal amount of instructions - %d\n"
-                 "\n[End!]\n\n";
-
-    llvm::Value *formatStrVal =
-        builder_->CreateGlobalStringPtr(formatStr, "BenchmarkResult");
-
-    std::vector<llvm::Value*> args;
-    args.push_back(formatStrVal);
-    for (size_t iNumInst = 0; iNumInst < N_INST + 1; iNumInst++) {
-        llvm::Value* pArg = builder_->CreateConstGEP2_32(benchmarkResult_.type,
-                                                         benchmarkResult_.array,
-                                                         0, iNumInst);
-        llvm::Value* arg = builder_->CreateLoad(pArg);
-        args.push_back(arg);
+std::string Translator::Impl::GetFunctionName(size_t entryPC) const
+{
+    size_t numFunc = std::lower_bound(funcEntries_.begin(), funcEntries_.end(),
+                                      entryPC) - funcEntries_.begin();
+    return "Function" + std::to_string(numFunc + 1);
+}
+
+size_t Translator::Impl::GetJumpTarget(size_t PC) const
+{
+    return PC + GetLabelOffset(bytecode_ + PC, GetArgtypeInstr(bytecode_[PC]));
+}
+
+void Translator::Impl::Verify() const
+{
+    std::string error;
+    llvm::raw_string_ostream errorStream(error);
+    if (llvm::verifyModule(*module_, &errorStream))
+        throw std::runtime_error("Translator: Invalid module\n" +
+                                 errorStream.str());
+}
+
+void Translator::Impl::Optimize(unsigned optLevel)
+{
+    if (optLevel == 0)
+        return;
+
+    Verify();
+    OptimizeModule(*module_, optLevel);
+}
+
+void Translator::Impl::EmitObject(const std::string& pathToObject)
+{
+    Verify();
+
+    std::error_code errorCode;
+    llvm::raw_fd_ostream objectFile(pathToObject, errorCode,
+                                    llvm::sys::fs::OF_None);
+    if (errorCode)
+        throw std::runtime_error("Translator: Can`t create object file " +
+                                 pathToObject + ": " + errorCode.message());
+
+    // Code generation changes IR, so it works on a copy of module
+    std::unique_ptr<llvm::Module> module = llvm::CloneModule(*module_);
+    EmitModuleObject(*module, objectFile);
+    objectFile.flush();
+}
+
+// Cache key is hash of bytecode and everything what changes native code:
+// options, host, LLVM and sources of translator and Runtime. Rebuilds of
+// the same sources share the cache.
+std::string Translator::Impl::GetCacheKey(unsigned optLevel) const
+{
+    std::unique_ptr<llvm::TargetMachine> targetMachine =
+        CreateHostTargetMachine();
+
+    std::string options = "O" + std::to_string(optLevel) +
+                          " analyse=" + std::to_string(isAnalyse_) +
+                          " benchmark=" + std::to_string(sizeBenchmark_) +
+                          " stack=" + std::to_string(stack_.size) +
+                          " profile=" + std::to_string(isProfile_) +
+                          " triple=" + targetMachine->getTargetTriple().str() +
+                          " cpu=" + targetMachine->getTargetCPU().str() +
+                          " features=" +
+                          targetMachine->getTargetFeatureString().str() +
+                          " llvm=" LLVM_VERSION_STRING
+                          " format=" + std::to_string(CACHE_FORMAT_VERSION) +
+                          " sources=" TRANSLATION_SOURCE_HASH;
+
+    llvm::SHA1 hasher;
+    hasher.update(llvm::ArrayRef<uint8_t>(bytecode_, sizeByteCode_));
+    hasher.update(options);
+
+    return llvm::toHex(hasher.final(), true);
+}
+
+int Translator::Impl::RunCached(const std::string& cacheDir, unsigned optLevel)
+{
+    std::error_code errorCode = llvm::sys::fs::create_directories(cacheDir);
+    if (errorCode)
+        throw std::runtime_error("Translator: Can`t create cache directory " +
+                                 cacheDir + ": " + errorCode.message());
+
+    llvm::SmallString<128> pathToObject(cacheDir);
+    llvm::sys::path::append(pathToObject, GetCacheKey(optLevel) + ".o");
+
+    if (!llvm::sys::fs::exists(pathToObject)) {
+        PreTranslate();
+        PreTranslateBenchmark();
+        Translate();
+        Optimize(optLevel);
+
+        // Concurrent runs of the same program must not see a partial object
+        std::string pathToTemp = pathToObject.str().str() + ".tmp" +
+            std::to_string(llvm::sys::Process::getProcessId());
+        EmitObject(pathToTemp);
+
+        errorCode = llvm::sys::fs::rename(pathToTemp, pathToObject);
+        if (errorCode) {
+            llvm::sys::fs::remove(pathToTemp);
+            throw std::runtime_error("Translator: Can`t store " +
+                                     pathToObject.str().str() + ": " +
+                                     errorCode.message());
+        }
     }
 
-    builder_->CreateCall(func, args);
+    std::unique_ptr<llvm::orc::LLJIT> jit = CreateJIT();
+
+    auto objectFile = llvm::MemoryBuffer::getFile(pathToObject);
+    if (!objectFile)
+        throw std::runtime_error("Translator: Can`t read " +
+                                 pathToObject.str().str() + ": " +
+                                 objectFile.getError().message());
+    CheckError(jit->addObjectFile(std::move(*objectFile)));
+
+    return RunMain(*jit);
 }
 
-llvm::BasicBlock* Translator::Impl::GetBB(size_t PC) const
+int Translator::Impl::Run()
 {
-    for (auto branchBB : branchBBs_) {
-        if (branchBB.second.truePC == PC)
-            return branchBB.second.trueBB;
-        if (branchBB.second.falsePC == PC)
-            return branchBB.second.falseBB;
+    Verify();
+
+    std::unique_ptr<llvm::orc::LLJIT> jit = CreateJIT();
+
+    CheckError(jit->addIRModule(
+        llvm::orc::ThreadSafeModule(llvm::CloneModule(*module_),
+                                    threadSafeContext_)));
+
+    return RunMain(*jit);
+}
+
+// Only main is translated before the run. Every guest function is called
+// through a lazy stub of ORC: the first call translates, optimizes and
+// compiles the function in a module of its own, the next ones go straight
+// to native code. Functions which are never called cost nothing.
+int Translator::Impl::RunLazy(unsigned optLevel)
+{
+    isLazy_ = true;
+    optLevel_ = optLevel;
+
+    PreTranslate();
+    PreTranslateBenchmark();
+    StartProfile();
+    CreateBlocks(0);
+    TranslateByteCode();
+
+    Verify();
+    Optimize(optLevel);
+
+    jit_ = CreateJIT();
+    llvm::orc::ExecutionSession& session = jit_->getExecutionSession();
+
+    callThroughManager_ = CheckError(llvm::orc::createLocalLazyCallThroughManager(
+        jit_->getTargetTriple(), session,
+        llvm::pointerToJITTargetAddress(&ReportLazyCompileError)));
+    stubsManager_ =
+        llvm::orc::createLocalIndirectStubsManagerBuilder(
+            jit_->getTargetTriple())();
+
+    // Bodies link against main JITDylib only, so their calls of guest
+    // functions go to stubs too instead of translating callees at once
+    llvm::orc::JITDylib& bodies = CheckError(jit_->createJITDylib("bodies"));
+    bodies.setLinkOrder({{&jit_->getMainJITDylib(),
+                          llvm::orc::JITDylibLookupFlags::
+                              MatchExportedSymbolsOnly}}, false);
+
+    llvm::orc::MangleAndInterner mangle(session, jit_->getDataLayout());
+    llvm::orc::SymbolAliasMap stubs;
+    for (size_t entryPC : funcEntries_) {
+        llvm::orc::SymbolStringPtr name = mangle(GetFunctionName(entryPC));
+        CheckError(bodies.define(
+            std::make_unique<FunctionUnit>(*this, entryPC, name)));
+        stubs[name] = {name, llvm::JITSymbolFlags::Exported |
+                             llvm::JITSymbolFlags::Callable};
     }
 
-    return nullptr;
+    if (!stubs.empty())
+        CheckError(jit_->getMainJITDylib().define(
+            llvm::orc::lazyReexports(*callThroughManager_, *stubsManager_,
+                                     bodies, std::move(stubs))));
+
+    CheckError(jit_->addIRModule(
+        llvm::orc::ThreadSafeModule(std::move(module_), threadSafeContext_)));
+
+    return RunMain(*jit_);
 }
 
-llvm::Function* Translator::Impl::GetFunction(size_t PC) const
+// Module is split into parts of whole guest functions, which are optimized
+// and compiled on nThreads threads. Every part moves to an LLVM context of
+// its own through bitcode, since threads can`t share a context. Functions
+// of different parts are not inlined into each other.
+std::vector<std::unique_ptr<llvm::MemoryBuffer>>
+Translator::Impl::CompileParallel(unsigned optLevel, unsigned nThreads)
 {
-    auto function = functions_.find(PC);
-    if (function != functions_.end())
-        return function->second;
+    Verify();
+
+    // Splitting externalizes globals of module, so it works on a copy
+    std::unique_ptr<llvm::Module> module = llvm::CloneModule(*module_);
+    unsigned nParts = std::min<size_t>(funcEntries_.size() + 1,
+                                       nThreads * PARTS_PER_THREAD);
+
+    std::vector<llvm::SmallVector<char, 0>> bitcodes;
+    llvm::SplitModule(*module, nParts,
+                      [&](std::unique_ptr<llvm::Module> part) {
+        bitcodes.emplace_back();
+        llvm::raw_svector_ostream output(bitcodes.back());
+        llvm::WriteBitcodeToFile(*part, output);
+    });
+    module.reset();
+
+    std::vector<std::unique_ptr<llvm::MemoryBuffer>> objects(bitcodes.size());
+    std::vector<std::shared_future<void>> results;
+
+    llvm::ThreadPool threadPool(llvm::hardware_concurrency(nThreads));
+    for (size_t iPart = 0; iPart < bitcodes.size(); iPart++)
+        results.push_back(threadPool.async([&, iPart]{
+            llvm::LLVMContext context;
+            llvm::MemoryBufferRef bitcode(
+                llvm::StringRef(bitcodes[iPart].data(), bitcodes[iPart].size()),
+                "Part" + std::to_string(iPart));
+            std::unique_ptr<llvm::Module> part =
+                CheckError(llvm::parseBitcodeFile(bitcode, context));
+
+            if (optLevel != 0)
+                OptimizeModule(*part, optLevel);
+
+            llvm::SmallVector<char, 0> object;
+            llvm::raw_svector_ostream output(object);
+            EmitModuleObject(*part, output);
+
+            objects[iPart] = std::make_unique<llvm::SmallVectorMemoryBuffer>(
+                std::move(object), bitcode.getBufferIdentifier());
+        }));
+
+    // Error of any part is thrown when all of them are done
+    threadPool.wait();
+    for (std::shared_future<void>& result : results)
+        result.get();
+
+    return objects;
+}
 
-    return nullptr;
+int Translator::Impl::RunParallel(unsigned optLevel, unsigned nThreads)
+{
+    std::vector<std::unique_ptr<llvm::MemoryBuffer>> objects =
+        CompileParallel(optLevel, nThreads);
+
+    std::unique_ptr<llvm::orc::LLJIT> jit = CreateJIT();
+    for (std::unique_ptr<llvm::MemoryBuffer>& object : objects)
+        CheckError(jit->addObjectFile(std::move(object)));
+
+    return RunMain(*jit);
+}
+
+void Translator::Impl::Compile()
+{
+    Verify();
+
+    jit_ = CreateJIT();
+
+    llvm::orc::MangleAndInterner mangle(jit_->getExecutionSession(),
+                                        jit_->getDataLayout());
+    CheckError(jit_->getMainJITDylib().define(llvm::orc::absoluteSymbols({
+        {mangle(regs_.name),
+         llvm::JITEvaluatedSymbol::fromPointer(guestState_.registers)},
+        {mangle(flag_.name),
+         llvm::JITEvaluatedSymbol::fromPointer(guestState_.flag)},
+        {mangle(memory_.name),
+         llvm::JITEvaluatedSymbol::fromPointer(guestState_.memory)},
+        {mangle(stack_.name),
+         llvm::JITEvaluatedSymbol::fromPointer(guestState_.stack)},
+        {mangle(stackTop_.name),
+         llvm::JITEvaluatedSymbol::fromPointer(guestState_.stackTop)},
+        {mangle(callDepth_.name),
+         llvm::JITEvaluatedSymbol::fromPointer(guestState_.callDepth)},
+    })));
+
+    CheckError(jit_->addIRModule(
+        llvm::orc::ThreadSafeModule(llvm::CloneModule(*module_),
+                                    threadSafeContext_)));
+
+    osrEntryPC_ = reinterpret_cast<int32_t*>(
+        CheckError(jit_->lookup("osrEntry")).getAddress());
+    exitedFlag_ = reinterpret_cast<int32_t*>(
+        CheckError(jit_->lookup(exited_.name)).getAddress());
+}
+
+bool Translator::Impl::HasNativeEntry(size_t PC) const
+{
+    return nativeEntries_.count(PC) != 0;
+}
+
+bool Translator::Impl::RunFrom(size_t PC)
+{
+    NativeEntry& entry = nativeEntries_.at(PC);
+    if (entry.address == nullptr)
+        entry.address = reinterpret_cast<void*>(
+            CheckError(jit_->lookup(entry.function)).getAddress());
+
+    if (entry.isLoopHeader)
+        *osrEntryPC_ = PC;
+
+    if (entry.isMain) {
+        reinterpret_cast<int (*)()>(entry.address)();
+        return true;
+    }
+
+    // Guest function which exits leaves output to main, which does not run
+    reinterpret_cast<void (*)()>(entry.address)();
+    if (*exitedFlag_ == 0)
+        return false;
+
+    RuntimeFlush();
+    return true;
 }
 
 // End of functions of class Translator::Impl ----------------------------------
 
-Translator::Translator(char* pathToInputFile, bool isAnalyse) :
-    pImpl_(std::make_unique<Impl>(pathToInputFile, isAnalyse)) {};
+
+Translator::Translator(char* pathToInputFile, bool isAnalyse,
+                       bool isProfile, size_t sizeBenchmark,
+                       size_t sizeStack) :
+    pImpl_(std::make_unique<Impl>(pathToInputFile, isAnalyse, isProfile,
+                                  sizeBenchmark, sizeStack)) {};
+
+Translator::Translator(ByteSpan bytecode, bool isAnalyse, bool isProfile,
+                       size_t sizeBenchmark, size_t sizeStack) :
+    pImpl_(std::make_unique<Impl>(bytecode, isAnalyse, isProfile,
+                                  sizeBenchmark, sizeStack)) {};
+
+Translator::Translator(ByteSpan bytecode, const GuestState& guestState) :
+    pImpl_(std::make_unique<Impl>(bytecode, guestState)) {};
 
 Translator::~Translator() = default;
 
@@ -827,6 +1942,51 @@ void Translator::Translate()
     pImpl_->Translate();
 }
 
+void Translator::Optimize(unsigned optLevel)
+{
+    pImpl_->Optimize(optLevel);
+}
+
+void Translator::EmitObject(const std::string& pathToObject)
+{
+    pImpl_->EmitObject(pathToObject);
+}
+
+int Translator::RunCached(const std::string& cacheDir, unsigned optLevel)
+{
+    return pImpl_->RunCached(cacheDir, optLevel);
+}
+
+int Translator::Run()
+{
+    return pImpl_->Run();
+}
+
+int Translator::RunLazy(unsigned optLevel)
+{
+    return pImpl_->RunLazy(optLevel);
+}
+
+int Translator::RunParallel(unsigned optLevel, unsigned nThreads)
+{
+    return pImpl_->RunParallel(optLevel, nThreads);
+}
+
+void Translator::Compile()
+{
+    pImpl_->Compile();
+}
+
+bool Translator::HasNativeEntry(size_t PC) const
+{
+    return pImpl_->HasNativeEntry(PC);
+}
+
+bool Translator::RunFrom(size_t PC)
+{
+    return pImpl_->RunFrom(PC);
+}
+
 void Translator::Dump() const
 {
     std::cout << ";#[LLVM_IR]:\n";
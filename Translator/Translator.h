@@ -1,8 +1,12 @@
 #ifndef BINARY_TRANSLATOR_TRANSLATOR_H
 #define BINARY_TRANSLATOR_TRANSLATOR_H
 
+#include "Bytecode.h"
+#include "GuestState.h"
+
 #include <experimental/propagate_const>
 #include <memory>
+#include <string>
 
 namespace BinaryTranslator {
 
@@ -13,7 +17,24 @@ private:
 
 public:
 
-    Translator(char* pathToInputFile, bool isAnalyse = false);
+    // isAnalyse - memory and stack start with input of benchmark programs,
+    // reversed array of sizeBenchmark words
+    // isProfile - count executions of basic blocks and print profile of
+    // guest program on its exit
+    // sizeStack - capacity of guest value stack and depth of guest calls,
+    // as sizeStack of CPU-Simulator
+    Translator(char* pathToInputFile, bool isAnalyse = false,
+               bool isProfile = false,
+               size_t sizeBenchmark = SIZE_MEMORY_BENCHMARK,
+               size_t sizeStack = SIZE_STACK);
+    // Bytecode is copied, so it does not have to outlive translator
+    Translator(ByteSpan bytecode, bool isAnalyse = false,
+               bool isProfile = false,
+               size_t sizeBenchmark = SIZE_MEMORY_BENCHMARK,
+               size_t sizeStack = SIZE_STACK);
+    // Translator of tiered execution: translated code works on guest state
+    // of CPU-Simulator and may be entered at guest functions and loop headers
+    Translator(ByteSpan bytecode, const GuestState& guestState);
 
     Translator(const Translator &) = delete;
     Translator &operator=(const Translator &) = delete;
@@ -23,6 +44,43 @@ public:
 
     void Translate();
 
+    // Runs LLVM O<optLevel> pipeline over translated module, 0 - does nothing
+    void Optimize(unsigned optLevel);
+
+    // Compiles translated module ahead of time into native object file for
+    // host, it has to be linked with Runtime library
+    void EmitObject(const std::string& pathToObject);
+
+    // Compiles translated module with ORC JIT and executes its main
+    int Run();
+
+    // Translates main and executes it with ORC JIT, guest functions are
+    // translated and compiled on their first call. It replaces Translate(),
+    // Optimize(optLevel) and Run().
+    int RunLazy(unsigned optLevel);
+
+    // Optimizes translated module and compiles it on nThreads threads, then
+    // executes its main. It replaces Optimize(optLevel) and Run(): guest
+    // functions are compiled in independent parts, so they are not inlined
+    // into each other.
+    int RunParallel(unsigned optLevel, unsigned nThreads);
+
+    // Compiles translated module with ORC JIT for RunFrom()
+    void Compile();
+
+    // True if compiled code may be entered at PC: entry of guest function or
+    // loop header
+    bool HasNativeEntry(size_t PC) const;
+
+    // Runs compiled code from PC until its guest function returns, returns
+    // true if guest program exited instead
+    bool RunFrom(size_t PC);
+
+    // Translate(), Optimize(optLevel) and Run() which keep native object in
+    // cacheDir, keyed by hash of bytecode and options. Next runs of the same
+    // bytecode load the object and skip translation and compilation.
+    int RunCached(const std::string& cacheDir, unsigned optLevel);
+
     void Dump() const;
 };
 
@@ -0,0 +1,62 @@
+#ifndef BINARY_TRANSLATOR_COMMON_BYTECODE_H_
+#define BINARY_TRANSLATOR_COMMON_BYTECODE_H_
+
+#include "Constants.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace BinaryTranslator {
+
+// Non-owning view of bytecode in memory
+struct ByteSpan {
+    const char* data = nullptr;
+    size_t size = 0;
+};
+
+// Operands wider than a byte are stored in little-endian order
+inline int32_t ReadInt32(const void* bytes)
+{
+    const unsigned char* byte = static_cast<const unsigned char*>(bytes);
+    return static_cast<int32_t>(uint32_t(byte[0])       |
+                                uint32_t(byte[1]) << 8  |
+                                uint32_t(byte[2]) << 16 |
+                                uint32_t(byte[3]) << 24);
+}
+
+// Offset of label of jump or call which starts at instr
+inline int GetLabelOffset(const void* instr, int argType)
+{
+    const unsigned char* byte = static_cast<const unsigned char*>(instr);
+    if (argType == WIDE_LABEL)
+        return ReadInt32(byte + 1);
+    return static_cast<signed char>(byte[1]);
+}
+
+// Immediate number of instruction which starts at instr
+inline int GetImmediate(const void* instr, int argType)
+{
+    const unsigned char* byte = static_cast<const unsigned char*>(instr);
+    switch (argType) {
+    case NUMBER:          return static_cast<signed char>(byte[1]);
+    case REG_NUMBER:      return static_cast<signed char>(byte[2]);
+    case WIDE_NUMBER:     return ReadInt32(byte + 1);
+    case REG_WIDE_NUMBER: return ReadInt32(byte + 2);
+
+    default:
+        return 0;
+    }
+}
+
+// Flag of compare: difference of operands wrapped to 32 bits, translated
+// code computes it the same way. Jumps test its sign, so they don`t order
+// operands whose difference overflows.
+inline int GetCompareFlag(int arg_1, int arg_2)
+{
+    return static_cast<int32_t>(static_cast<uint32_t>(arg_1) -
+                                static_cast<uint32_t>(arg_2));
+}
+
+} //namespace BinaryTranslator
+
+#endif // BINARY_TRANSLATOR_COMMON_BYTECODE_H_
@@ -1,8 +1,22 @@
 #ifndef BINARY_TRANSLATOR_COMMON_CONSTANTS_H_
 #define BINARY_TRANSLATOR_COMMON_CONSTANTS_H_
 
+#include <cstddef>
+
 namespace BinaryTranslator {
 
+// Guest memory in 4-byte words, the same for CPU-Simulator and translated code
+const size_t SIZE_MEMORY = 1000;
+// Default length of array sorted by benchmark programs in analyse mode, they
+// compare the last element with the next word, so it has to stay inside
+// memory
+const size_t SIZE_MEMORY_BENCHMARK = SIZE_MEMORY - 1;
+// Capacity of guest value stack in words
+const size_t SIZE_STACK = 1 << 16;
+
+// The longest instruction of Commands_DSL.txt in bytes
+const size_t MAX_SIZE_INSTR = 6;
+
 enum NumInstructions {
     NUM_PUSH = 0,
     NUM_PUSH_R,
@@ -44,6 +58,23 @@ enum NumInstructions {
     NUM_WRITE_P,
     NUM_READ_P,
 
+    NUM_JMP_W,
+    NUM_CALL_W,
+    NUM_JG_W,
+    NUM_JGE_W,
+    NUM_JL_W,
+    NUM_JLE_W,
+    NUM_JE_W,
+    NUM_JNE_W,
+
+    NUM_PUSH_W,
+    NUM_MOV_W,
+    NUM_ADD_W,
+    NUM_SUB_W,
+    NUM_IMUL_W,
+    NUM_IDIV_W,
+    NUM_CMP_W,
+
     N_INST,
 };
 
@@ -87,6 +118,27 @@ enum IdInstructions {
     CMP_PP = 0x3D,
     WRITE_P = 0xE7,
     READ_P  = 0xE5,
+
+    // Jumps and calls with 32-bit offset, assembler emits them only for
+    // labels which are out of range of 8-bit offset
+    JMP_W = 0xEB,
+    CALL_W = 0x9A,
+    JG_W = 0x7F,
+    JGE_W = 0x7D,
+    JL_W = 0x7C,
+    JLE_W = 0x7E,
+    JE_W = 0x74,
+    JNE_W = 0x84,
+
+    // Instructions with 32-bit immediate, assembler emits them only for
+    // numbers which do not fit in a signed byte
+    PUSH_W = 0x6A,
+    MOV_W = 0xB9,
+    ADD_W = 0x05,
+    SUB_W = 0x2D,
+    IMUL_W = 0x69,
+    IDIV_W = 0xF5,
+    CMP_W = 0x3A,
 };
 
 enum Registers {
@@ -104,6 +156,9 @@ enum Argtypes {
     REG,
     REG_REG,
     REG_NUMBER,
+    WIDE_LABEL,
+    WIDE_NUMBER,
+    REG_WIDE_NUMBER,
 };
 
 } //namespace BinaryTranslator
@@ -0,0 +1,146 @@
+#ifndef BINARY_TRANSLATOR_COMMON_FUSION_H_
+#define BINARY_TRANSLATOR_COMMON_FUSION_H_
+
+#include "Constants.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace BinaryTranslator {
+
+// Peephole fusion shared by CPU-Simulator and Translator: compare and the
+// conditional jump after it, optionally preceded by inc/dec of loop counter,
+// are executed as one superinstruction
+enum Fusions {
+    FUSION_NONE,
+    FUSION_CMP,
+    FUSION_CMP_R,
+    FUSION_CMP_RP,
+    FUSION_CMP_PP,
+    FUSION_INC_CMP,
+    FUSION_INC_CMP_R,
+    FUSION_DEC_CMP,
+    FUSION_DEC_CMP_R,
+    N_FUSIONS,
+};
+
+// Conditions of jg..jne, jumps with 8-bit and 32-bit offset share them
+enum Conditions {
+    CONDITION_G,
+    CONDITION_GE,
+    CONDITION_L,
+    CONDITION_LE,
+    CONDITION_E,
+    CONDITION_NE,
+    N_CONDITIONS,
+};
+
+struct FusedInstr {
+    int fusion = FUSION_NONE;
+    int condition = N_CONDITIONS;
+    // Compare and jump, inc/dec if any is at PC of superinstruction
+    size_t cmpPC = 0;
+    size_t jumpPC = 0;
+    size_t nInstrs = 0;
+    size_t size = 0;
+};
+
+// N_CONDITIONS for instructions which are not conditional jumps
+inline int GetJumpCondition(int idInstr)
+{
+    switch (idInstr) {
+    case JG:
+    case JG_W:  return CONDITION_G;
+    case JGE:
+    case JGE_W: return CONDITION_GE;
+    case JL:
+    case JL_W:  return CONDITION_L;
+    case JLE:
+    case JLE_W: return CONDITION_LE;
+    case JE:
+    case JE_W:  return CONDITION_E;
+    case JNE:
+    case JNE_W: return CONDITION_NE;
+
+    default:
+        return N_CONDITIONS;
+    }
+}
+
+// Size of instruction which may be a part of superinstruction, 0 otherwise
+inline size_t GetSizeFusedPart(int idInstr)
+{
+    #define INSTRUCTION(name, id, argType, num, size, code)  \
+        case id: return size;                                \
+
+    #define INSTRUCTIONS
+    switch (idInstr) {
+    #include "Commands_DSL.txt"
+
+    default:
+        return 0;
+    }
+
+    #undef INSTRUCTIONS
+    #undef INSTRUCTION
+}
+
+// Superinstruction which starts at PC of bytecode, FUSION_NONE if there is
+// no one. isLeader marks PCs where control may come from elsewhere, they can
+// only be the first part of superinstruction.
+inline FusedInstr MatchFusion(const void* bytecode, size_t sizeByteCode,
+                              size_t PC, const std::vector<bool>& isLeader)
+{
+    const unsigned char* byte = static_cast<const unsigned char*>(bytecode);
+    FusedInstr fused;
+
+    int idPrefix = byte[PC];
+    bool isPrefixed = (idPrefix == INC || idPrefix == DEC);
+
+    size_t cmpPC = isPrefixed ? PC + GetSizeFusedPart(idPrefix) : PC;
+    if (cmpPC >= sizeByteCode || (isPrefixed && isLeader[cmpPC]))
+        return fused;
+
+    switch (byte[cmpPC]) {
+    case CMP:
+    case CMP_W:
+        fused.fusion = !isPrefixed          ? FUSION_CMP     :
+                       (idPrefix == INC)    ? FUSION_INC_CMP :
+                                              FUSION_DEC_CMP;
+        break;
+
+    case CMP_R:
+        fused.fusion = !isPrefixed          ? FUSION_CMP_R     :
+                       (idPrefix == INC)    ? FUSION_INC_CMP_R :
+                                              FUSION_DEC_CMP_R;
+        break;
+
+    case CMP_RP:
+        fused.fusion = isPrefixed ? FUSION_NONE : FUSION_CMP_RP;
+        break;
+
+    case CMP_PP:
+        fused.fusion = isPrefixed ? FUSION_NONE : FUSION_CMP_PP;
+        break;
+    }
+
+    size_t jumpPC = cmpPC + GetSizeFusedPart(byte[cmpPC]);
+    if (fused.fusion == FUSION_NONE || jumpPC >= sizeByteCode ||
+        isLeader[jumpPC])
+        return {};
+
+    fused.condition = GetJumpCondition(byte[jumpPC]);
+    size_t endPC = jumpPC + GetSizeFusedPart(byte[jumpPC]);
+    if (fused.condition == N_CONDITIONS || endPC > sizeByteCode)
+        return {};
+
+    fused.cmpPC = cmpPC;
+    fused.jumpPC = jumpPC;
+    fused.nInstrs = isPrefixed ? 3 : 2;
+    fused.size = endPC - PC;
+    return fused;
+}
+
+} //namespace BinaryTranslator
+
+#endif // BINARY_TRANSLATOR_COMMON_FUSION_H_
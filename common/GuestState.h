@@ -0,0 +1,28 @@
+#ifndef BINARY_TRANSLATOR_COMMON_GUESTSTATE_H_
+#define BINARY_TRANSLATOR_COMMON_GUESTSTATE_H_
+
+#include <cstddef>
+
+namespace BinaryTranslator {
+
+// Guest state owned by CPU-Simulator. In tiered execution translated code
+// works on it directly, so interpreter and native code share registers
+// and memory without copying them on every transfer of control.
+struct GuestState {
+    int* registers = nullptr;
+    // Flag of the last compare, it lives across guest calls and returns
+    int* flag = nullptr;
+    int* memory = nullptr;
+    size_t sizeMemory = 0;
+    // Value stack: words and number of them
+    int* stack = nullptr;
+    size_t* stackTop = nullptr;
+    size_t sizeStack = 0;
+    // Return stack: native calls only count their depth in it
+    size_t* callDepth = nullptr;
+    size_t sizeCallStack = 0;
+};
+
+} //namespace BinaryTranslator
+
+#endif // BINARY_TRANSLATOR_COMMON_GUESTSTATE_H_
@@ -1,19 +1,364 @@
-
 #include "Assembler.h"
+#include "Runtime.h"
 #include "Simulator.h"
+#include "TieredExecutor.h"
 #include "Translator.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
 //TODO refactor .gitignore
 
+namespace {
+
+enum Modes {
+    MODE_DUMP,
+    MODE_JIT,
+    MODE_SIM,
+    MODE_OBJ,
+    MODE_EXE,
+    MODE_TIERED,
+};
+
+enum ReportFormats {
+    REPORT_JSON,
+    REPORT_CSV,
+};
+
+const char kUsage[] = "Usage: Binary_Translator <input.txt> <output.bin> "
+                      "[--dump | --jit | --sim | --tiered | "
+                      "--emit-obj=<file.o> | --emit-exe=<file>] "
+                      "[-O0 | -O1 | -O2 | -O3] "
+                      "[--dispatch=switch | --dispatch=threaded | "
+                      "--dispatch=predecoded] [--stack-size=<N>] "
+                      "[--cache-dir=<dir>] [--lazy] [--jobs=<N>] "
+                      "[--tier-threshold=<N>] [--profile] "
+                      "[--report=<file>] [--report-format=json | "
+                      "--report-format=csv]\n";
+
+struct Options {
+    int mode = MODE_DUMP;
+    std::string pathToOutput;
+    unsigned optLevel = 0;
+    std::string cacheDir;
+    bool isLazy = false;
+    unsigned nJobs = 1;
+    bool isProfile = false;
+    // Machine-readable report of the run is appended to reportPath
+    std::string reportPath;
+    int reportFormat = REPORT_JSON;
+    // Options of engine which runs, they name it in report
+    std::string engine;
+    BinaryTranslator::SimulatorConfig simulator;
+};
+
+Options ParseOptions(int argc, char** argv)
+{
+    Options options;
+    std::vector<std::string> engineOptions;
+
+    for (int iArg = 3; iArg < argc; iArg++) {
+        const char* option = argv[iArg];
+
+        if (!strcmp(option, "--dump"))
+            options.mode = MODE_DUMP;
+        else if (!strcmp(option, "--jit"))
+            options.mode = MODE_JIT;
+        else if (!strcmp(option, "--sim"))
+            options.mode = MODE_SIM;
+        else if (!strcmp(option, "--tiered"))
+            options.mode = MODE_TIERED;
+        else if (!strncmp(option, "--emit-obj=", 11) && option[11] != '\0') {
+            options.mode = MODE_OBJ;
+            options.pathToOutput = option + 11;
+        }
+        else if (!strncmp(option, "--emit-exe=", 11) && option[11] != '\0') {
+            options.mode = MODE_EXE;
+            options.pathToOutput = option + 11;
+        }
+        else if (!strncmp(option, "-O", 2) && option[2] >= '0' &&
+                 option[2] <= '3' && option[3] == '\0')
+            options.optLevel = option[2] - '0';
+        else if (!strcmp(option, "--dispatch=switch"))
+            options.simulator.dispatch = BinaryTranslator::DISPATCH_SWITCH;
+        else if (!strcmp(option, "--dispatch=threaded"))
+            options.simulator.dispatch = BinaryTranslator::DISPATCH_THREADED;
+        else if (!strcmp(option, "--dispatch=predecoded"))
+            options.simulator.dispatch =
+                BinaryTranslator::DISPATCH_PREDECODED;
+        else if (!strncmp(option, "--stack-size=", 13) &&
+                 atoll(option + 13) > 0)
+            options.simulator.sizeStack = atoll(option + 13);
+        else if (!strncmp(option, "--cache-dir=", 12) && option[12] != '\0')
+            options.cacheDir = option + 12;
+        else if (!strcmp(option, "--lazy"))
+            options.isLazy = true;
+        else if (!strncmp(option, "--jobs=", 7) && atoi(option + 7) > 0)
+            options.nJobs = atoi(option + 7);
+        else if (!strncmp(option, "--tier-threshold=", 17) &&
+                 atoll(option + 17) > 0)
+            options.simulator.tierUpThreshold = atoll(option + 17);
+        else if (!strcmp(option, "--profile")) {
+            options.isProfile = true;
+            options.simulator.isProfile = true;
+        }
+        else if (!strncmp(option, "--report=", 9) && option[9] != '\0')
+            options.reportPath = option + 9;
+        else if (!strcmp(option, "--report-format=json"))
+            options.reportFormat = REPORT_JSON;
+        else if (!strcmp(option, "--report-format=csv"))
+            options.reportFormat = REPORT_CSV;
+        else {
+            std::cerr << "Error: Unknown option " << option << "\n" << kUsage;
+            exit(EXIT_FAILURE);
+        }
+
+        if (strncmp(option, "--report", 8) != 0 && strcmp(option, "--profile"))
+            engineOptions.push_back(option);
+    }
+
+    // Each of them is a separate way to run JIT, none of them wins silently
+    int nJitRuns = !options.cacheDir.empty() + options.isLazy +
+                   (options.nJobs > 1);
+    if (nJitRuns > 1) {
+        std::cerr << "Error: --cache-dir, --lazy and --jobs can`t be "
+                     "combined\n" << kUsage;
+        exit(EXIT_FAILURE);
+    }
+
+    // Native code of tiered execution has no block counters
+    if (options.isProfile && options.mode == MODE_TIERED) {
+        std::cerr << "Error: --profile can`t be combined with --tiered\n"
+                  << kUsage;
+        exit(EXIT_FAILURE);
+    }
+
+    if (!options.reportPath.empty()) {
+        if (options.mode != MODE_JIT && options.mode != MODE_SIM &&
+            options.mode != MODE_TIERED) {
+            std::cerr << "Error: --report needs --jit, --sim or --tiered\n"
+                      << kUsage;
+            exit(EXIT_FAILURE);
+        }
+
+        // Instructions of report are counted by profile, which is printed
+        // only if it is asked for
+        RuntimeSetProfilePrinted(options.isProfile);
+        options.isProfile = true;
+        options.simulator.isProfile = true;
+
+        // Counters are part of the measured run, so report marks its time
+        // as profiled and names the engine which actually runs: profiled
+        // CPU-Simulator interprets predecoded code as threaded
+        if (options.mode == MODE_SIM &&
+            options.simulator.dispatch ==
+                BinaryTranslator::DISPATCH_PREDECODED) {
+            options.simulator.dispatch = BinaryTranslator::DISPATCH_THREADED;
+            std::replace(engineOptions.begin(), engineOptions.end(),
+                         std::string("--dispatch=predecoded"),
+                         std::string("--dispatch=threaded"));
+        }
+    }
+
+    for (const std::string& option : engineOptions)
+        options.engine += (options.engine.empty() ? "" : " ") + option;
+
+    return options;
+}
+
+template <typename Func>
+double MeasureTime(const char* engine, Func func)
+{
+    auto start = std::chrono::steady_clock::now();
+    func();
+    auto end = std::chrono::steady_clock::now();
+
+    std::chrono::duration<double, std::milli> time = end - start;
+    std::cerr << "[Time] " << engine << ": " << time.count() << " ms\n";
+    return time.count();
+}
+
+// Control characters are not allowed in JSON strings, they are escaped too
+std::string QuoteJson(const std::string& text)
+{
+    std::string quoted = "\"";
+    for (char symbol : text) {
+        switch (symbol) {
+        case '"':
+        case '\\':
+            quoted += '\\';
+            quoted += symbol;
+            break;
+
+        case '\n': quoted += "\\n"; break;
+        case '\r': quoted += "\\r"; break;
+        case '\t': quoted += "\\t"; break;
+
+        default:
+            if (static_cast<unsigned char>(symbol) < 0x20) {
+                char escaped[sizeof("\\u0000")];
+                snprintf(escaped, sizeof(escaped), "\\u%04x",
+                         static_cast<unsigned char>(symbol));
+                quoted += escaped;
+            }
+            else
+                quoted += symbol;
+        }
+    }
+    return quoted + "\"";
+}
+
+std::string QuoteCsv(const std::string& text)
+{
+    std::string quoted = "\"";
+    for (char symbol : text) {
+        if (symbol == '"')
+            quoted += '"';
+        quoted += symbol;
+    }
+    return quoted + "\"";
+}
+
+// Appends one record of the run to report: a line of JSON Lines or a row of
+// CSV, the header of which is written to empty file. Instructions are
+// counted by profile, so time of counted runs includes its counters;
+// tiered execution has no counts of native code and is not profiled.
+void WriteReport(const Options& options, const char* pathToProgram,
+                 double timeMs)
+{
+    using namespace BinaryTranslator;
+
+    if (options.reportPath.empty())
+        return;
+
+    FILE* report = fopen(options.reportPath.c_str(), "a");
+    if (report == nullptr) {
+        std::cerr << "Error: Can`t open report " << options.reportPath << "\n";
+        return;
+    }
+
+    bool isCounted = (options.mode != MODE_TIERED);
+    uint64_t nTotal = RuntimeGetProfileCount(N_INST);
+    double nPerSecond = (timeMs > 0) ? nTotal / (timeMs / 1000) : 0;
+
+    #define INSTRUCTIONS
+
+    if (options.reportFormat == REPORT_CSV) {
+        fseek(report, 0, SEEK_END);
+        if (ftell(report) == 0) {
+            fputs("program,engine,profiled,time_ms,instructions,"
+                  "instructions_per_second", report);
+            #define INSTRUCTION(name, id, argType, num, size, code)  \
+                fputs("," #name, report);                            \
+
+            #include "Commands_DSL.txt"
+            #undef INSTRUCTION
+            fputs("\n", report);
+        }
+
+        fprintf(report, "%s,%s,%s,%.3f", QuoteCsv(pathToProgram).c_str(),
+                QuoteCsv(options.engine).c_str(),
+                isCounted ? "true" : "false", timeMs);
+        if (isCounted)
+            fprintf(report, ",%" PRIu64 ",%.0f", nTotal, nPerSecond);
+        else
+            fputs(",,", report);
+
+        #define INSTRUCTION(name, id, argType, num, size, code)         \
+            if (isCounted)                                              \
+                fprintf(report, ",%" PRIu64, RuntimeGetProfileCount(num)); \
+            else                                                        \
+                fputs(",", report);                                     \
+
+        #include "Commands_DSL.txt"
+        #undef INSTRUCTION
+        fputs("\n", report);
+    }
+    else {
+        fprintf(report, "{\"program\": %s, \"engine\": %s, \"profiled\": %s, "
+                        "\"timeMs\": %.3f",
+                QuoteJson(pathToProgram).c_str(),
+                QuoteJson(options.engine).c_str(),
+                isCounted ? "true" : "false", timeMs);
+
+        if (isCounted) {
+            fprintf(report, ", \"instructions\": %" PRIu64
+                            ", \"instructionsPerSecond\": %.0f, "
+                            "\"opcodes\": {", nTotal, nPerSecond);
+            const char* separator = "";
+            #define INSTRUCTION(name, id, argType, num, size, code)      \
+                fprintf(report, "%s\"" #name "\": %" PRIu64, separator,  \
+                        RuntimeGetProfileCount(num));                    \
+                separator = ", ";                                        \
+
+            #include "Commands_DSL.txt"
+            #undef INSTRUCTION
+            fputs("}", report);
+        }
+        else
+            fputs(", \"instructions\": null, "
+                  "\"instructionsPerSecond\": null, \"opcodes\": null",
+                  report);
+
+        fputs("}\n", report);
+    }
+
+    #undef INSTRUCTIONS
+
+    fclose(report);
+}
+
+// Every way to run JIT translates, compiles and runs the program, so time of
+// all of them covers the same work as time of the simulator
+void RunJit(BinaryTranslator::Translator& translator, const Options& options)
+{
+    if (!options.cacheDir.empty())
+        translator.RunCached(options.cacheDir, options.optLevel);
+    else if (options.isLazy)
+        translator.RunLazy(options.optLevel);
+    else if (options.nJobs > 1) {
+        translator.Translate();
+        translator.RunParallel(options.optLevel, options.nJobs);
+    }
+    else {
+        translator.Translate();
+        translator.Optimize(options.optLevel);
+        translator.Run();
+    }
+}
+
+void LinkExecutable(const std::string& pathToObject,
+                    const std::string& pathToExecutable)
+{
+    std::string command = std::string(LINKER) + " \"" + pathToObject +
+                          "\" \"" + RUNTIME_LIBRARY + "\" -o \"" +
+                          pathToExecutable + "\"";
+
+    if (std::system(command.c_str()) != 0)
+        throw std::runtime_error("Error: Can`t link " + pathToExecutable);
+}
+
+} // anonymous namespace
+
 int main(int argc, char** argv)
 {
-    if (argc != 3) {
-        std::cerr << "Error: Incorrect number of arguments\n";
+    if (argc < 3) {
+        std::cerr << "Error: Incorrect number of arguments\n" << kUsage;
         exit(EXIT_FAILURE);
     }
 
+    Options options = ParseOptions(argc, argv);
+    options.simulator.isAnalyse = true;
+
+    // Bytecode is written to output file and passed further in memory
+    BinaryTranslator::Assembler assembler(argv[1], argv[2]);
     try {
-        BinaryTranslator::Assembler assembler(argv[1], argv[2]);
         assembler.Assemble();
         // assembler.Dump();
     }
@@ -21,24 +366,78 @@ int main(int argc, char** argv)
         std::cerr << exception.what() << "\n";
         exit(EXIT_FAILURE);
     }
+    BinaryTranslator::ByteSpan bytecode = assembler.GetByteCode();
 
-    // try {
-    //     BinaryTranslator::CpuSimulator cpuSimulator;
-    //     cpuSimulator.Run(argv[2]);
-    // }
-    // catch (std::exception &exception) {
-    //     std::cerr << exception.what() << "\n";
-    //     exit(EXIT_FAILURE);
-    // }
+    if (options.mode == MODE_SIM) {
+        try {
+            BinaryTranslator::CpuSimulator cpuSimulator(options.simulator);
+            double time = MeasureTime("Simulator", [&]{
+                cpuSimulator.Run(bytecode);
+            });
+            WriteReport(options, argv[1], time);
+        }
+        catch (std::exception &exception) {
+            std::cerr << exception.what() << "\n";
+            exit(EXIT_FAILURE);
+        }
+
+        return 0;
+    }
 
+    // Simulator starts at once and hands hot code to JIT
+    if (options.mode == MODE_TIERED) {
+        try {
+            BinaryTranslator::TieredExecutor tieredExecutor(options.optLevel);
+            options.simulator.tierUp = &tieredExecutor;
+
+            BinaryTranslator::CpuSimulator cpuSimulator(options.simulator);
+            double time = MeasureTime("Tiered", [&]{
+                cpuSimulator.Run(bytecode);
+            });
+            WriteReport(options, argv[1], time);
+        }
+        catch (std::exception &exception) {
+            std::cerr << exception.what() << "\n";
+            exit(EXIT_FAILURE);
+        }
+
+        return 0;
+    }
 
     try {
-        BinaryTranslator::Translator translator(argv[2], true);
+        BinaryTranslator::Translator translator(
+            bytecode, true, options.isProfile,
+            BinaryTranslator::SIZE_MEMORY_BENCHMARK,
+            options.simulator.sizeStack);
+
+        if (options.mode == MODE_JIT) {
+            double time = MeasureTime("JIT", [&]{
+                RunJit(translator, options);
+            });
+            WriteReport(options, argv[1], time);
+            return 0;
+        }
+
         translator.Translate();
-        translator.Dump();
+        translator.Optimize(options.optLevel);
+
+        switch (options.mode) {
+        case MODE_OBJ:
+            translator.EmitObject(options.pathToOutput);
+            break;
+
+        case MODE_EXE:
+            translator.EmitObject(options.pathToOutput + ".o");
+            LinkExecutable(options.pathToOutput + ".o", options.pathToOutput);
+            break;
+
+        default:
+            translator.Dump();
+        }
     }
     catch(std::runtime_error& exception){
-        std::cerr << exception.what();
+        std::cerr << exception.what() << "\n";
+        exit(EXIT_FAILURE);
     }
 
     return 0;